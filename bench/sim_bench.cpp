@@ -0,0 +1,121 @@
+/*  วัดความเร็วของ simulator (Google Benchmark): รันแต่ละ kernel ใน kernels/ ด้วยทุก engine
+    sweep/scalar, sweep/lockstep รัน collatz.asm ด้วย $a0 ต่างกันหลายค่า: ทีละค่าด้วย CPU::run เทียบกับ LockstepCPU ที่รันทุกค่าพร้อมกัน
+    counter MIPS = ล้านคำสั่งที่จำลองได้ต่อวินาที (เวลาจริงของ host) รวมเวลา reset/load CPU ของแต่ละรอบด้วย
+    เทียบผลสองครั้งด้วย --benchmark_out=result.json แล้วใช้ compare.py ของ Google Benchmark
+*/
+#include "cpu.h"
+
+#include <benchmark/benchmark.h>
+
+#ifndef KERNEL_DIR
+#define KERNEL_DIR "kernels"
+#endif
+
+enum Engine
+{
+    ENGINE_INTERP,
+    ENGINE_BLOCKS,
+    ENGINE_PIPELINE,
+    ENGINE_CACHE,
+};
+
+static void runKernel(benchmark::State &state, const string &file, Engine engine)
+{
+    CPU cpu;
+    Program prog = cpu.loadProgram(string(KERNEL_DIR) + "/" + file);
+    CacheConfig l1;
+    CacheConfig l2 = {256 * 1024, 8, 64, REPL_LRU, true, 10};
+    unique_ptr<CacheHierarchy> caches;
+    long long instructions = 0;
+    for (auto _ : state)
+    {
+        cpu.reset();
+        cpu.load(prog);
+        if (engine == ENGINE_CACHE)
+        {
+            caches.reset(new CacheHierarchy(l1, l1, l2));
+            cpu.caches = caches.get();
+        }
+        long long executed;
+        if (engine == ENGINE_BLOCKS)
+            executed = cpu.runBlocks();
+        else if (engine == ENGINE_PIPELINE)
+        {
+            Pipeline pipe(BranchPredictor(PRED_GSHARE), true);
+            executed = cpu.runPipeline(pipe);
+            benchmark::DoNotOptimize(pipe.cycles());
+        }
+        else
+            executed = cpu.run();
+        instructions += executed;
+        benchmark::DoNotOptimize(cpu.registers[2]);
+    }
+    state.counters["MIPS"] = benchmark::Counter((double)instructions / 1e6, benchmark::Counter::kIsRate);
+    state.counters["instructions"] = (double)instructions / (double)state.iterations();
+}
+
+// รัน collatz.asm กับ $a0 = 1..lanes (state.range(0)) ด้วย CPU ทีละค่า หรือ LockstepCPU ครั้งเดียว
+static void runSweep(benchmark::State &state, bool lockstep)
+{
+    const uint32_t lanes = (uint32_t)state.range(0);
+    CPU cpu;
+    Program prog = cpu.loadProgram(string(KERNEL_DIR) + "/collatz.asm");
+    LockstepCPU group(lanes);
+    long long instructions = 0;
+    for (auto _ : state)
+    {
+        if (lockstep)
+        {
+            group.load(prog);
+            for (uint32_t lane = 0; lane < lanes; lane++)
+                group.reg(lane, 4) = (int32_t)lane + 1;
+            instructions += group.run();
+            benchmark::DoNotOptimize(group.regs.data());
+            continue;
+        }
+        for (uint32_t lane = 0; lane < lanes; lane++)
+        {
+            cpu.reset();
+            cpu.load(prog);
+            cpu.registers[4] = (int)lane + 1;
+            instructions += cpu.run();
+            benchmark::DoNotOptimize(cpu.registers[2]);
+        }
+    }
+    state.counters["MIPS"] = benchmark::Counter((double)instructions / 1e6, benchmark::Counter::kIsRate);
+    if (lockstep)
+        state.counters["efficiency"] = (double)instructions / ((double)group.issued * lanes); // สัดส่วน lane ที่ทำงานต่อคำสั่งที่ issue
+}
+
+static void registerBenchmarks()
+{
+    const char *kernels[] = {"matmul.asm", "memcpy.asm", "bubble_sort.asm", "fib.asm", "list_walk.asm", "crc32.asm", "collatz.asm"};
+    const pair<Engine, const char *> engines[] = {
+        {ENGINE_INTERP, "interp"}, {ENGINE_BLOCKS, "blocks"}, {ENGINE_PIPELINE, "pipeline"}, {ENGINE_CACHE, "cache"}};
+    for (const char *kernel : kernels)
+    {
+        for (const auto &engine : engines)
+        {
+            string name = string(kernel).substr(0, strlen(kernel) - 4) + "/" + engine.second;
+            string file = kernel;
+            Engine which = engine.first;
+            benchmark::RegisterBenchmark(name.c_str(), [file, which](benchmark::State &state) { runKernel(state, file, which); })
+                ->Unit(benchmark::kMicrosecond);
+        }
+    }
+    benchmark::RegisterBenchmark("sweep/scalar", [](benchmark::State &state) { runSweep(state, false); })
+        ->Arg(64)->Arg(1024)->Unit(benchmark::kMicrosecond);
+    benchmark::RegisterBenchmark("sweep/lockstep", [](benchmark::State &state) { runSweep(state, true); })
+        ->Arg(64)->Arg(1024)->Unit(benchmark::kMicrosecond);
+}
+
+int main(int argc, char **argv)
+{
+    registerBenchmarks();
+    benchmark::Initialize(&argc, argv);
+    if (benchmark::ReportUnrecognizedArguments(argc, argv))
+        return 1;
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+    return 0;
+}
@@ -0,0 +1,2650 @@
+// ส่วน implementation ของ class CPU: assembler, loader, engine ทุกแบบ, basic-block cache, ตัวอ่าน trace และ lockstep engine (ดู cpu.h)
+#include "cpu.h"
+
+#if defined(__AVX512F__) || defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
+// แปลง string เป็นตัวเลข รับทั้งเลขฐาน 10 และฐาน 16 แบบ 0x.. (ติดลบได้)
+int parseImm(const string &text)
+{
+    size_t digits = (!text.empty() && (text[0] == '-' || text[0] == '+')) ? 1 : 0;
+    bool hex = text.size() > digits + 1 && text[digits] == '0' && (text[digits + 1] == 'x' || text[digits + 1] == 'X');
+    return (int)stoll(text, nullptr, hex ? 16 : 10);
+}
+
+/*  target ของ branch/jump เป็นได้ทั้งตัวเลขและ label
+    relative = true (beq/bne): offset นับเป็น word จากคำสั่งถัดไป (PC + 4) -> label - (index + 1)
+    relative = false (j/jal): word address ของ label เลย
+*/
+int CPU::branchTarget(const string &token, const Program *prog, int index, bool relative)
+{
+    if (isdigit((unsigned char)token[0]) || token[0] == '-' || token[0] == '+')
+    {
+        return parseImm(token);
+    }
+    if (prog == nullptr)
+    {
+        throw runtime_error("Label " + token + " can only be used in program mode");
+    }
+    auto it = prog->labels.find(token);
+    if (it == prog->labels.end())
+    {
+        throw runtime_error("Undefined label: " + token);
+    }
+    return relative ? it->second - (index + 1) : it->second;
+}
+
+// ค่าของ li/la: ตัวเลข หรือ byte address ของ label (label ใน .data หรือ label ใน text)
+int CPU::immediate(const string &token, const Program *prog)
+{
+    if (isdigit((unsigned char)token[0]) || token[0] == '-' || token[0] == '+' || prog == nullptr)
+    {
+        return parseImm(token);
+    }
+    auto data = prog->data_labels.find(token);
+    if (data != prog->data_labels.end())
+    {
+        return (int)data->second;
+    }
+    auto text = prog->labels.find(token);
+    if (text == prog->labels.end())
+    {
+        throw runtime_error("Undefined label: " + token);
+    }
+    return (int)prog->text_base + text->second * 4;
+}
+
+int CPU::regIndex(const string &name, const string &instruction)
+{
+    auto it = reg_map.find(name);
+    if (it == reg_map.end())
+    {
+        throw runtime_error("Invalid register: " + name + " in " + instruction);
+    }
+    return it->second;
+}
+
+/*  ถอดรหัสคำสั่ง 1 บรรทัด ทำงานแค่ตอนโหลดโปรแกรม (ไม่ใช่ทุกครั้งที่ execute)
+    รูปแบบที่รับได้ เช่น "add $t0 $t1 $t2", "add $t0, $t1, $t2", "lw $t0 4($t1)", "beq $t0 $t1 -2", "j 10"
+    ถ้าส่ง prog มาด้วย target ของ branch/j/jal จะเป็นชื่อ label ได้ (index = ตำแหน่งของคำสั่งนี้ในโปรแกรม)
+    immediate ของ addi/andi/ori/... ใช้ได้เต็ม 32 bit (ไม่ต้องแยกเป็น lui + ori เหมือนใน machine code)
+*/
+Instr CPU::decode(const string &instruction, const Program *prog, int index)
+{
+    string line = instruction;
+    replace(line.begin(), line.end(), ',', ' '); // ใส่ , คั่นก็ได้ไม่ใส่ก็ได้
+
+    string op;
+    istringstream iss(line);
+    iss >> op;
+
+    auto found = instr_map.find(op);
+    if (found == instr_map.end())
+    {
+        throw runtime_error("Unknown instruction: " + op);
+    }
+
+    Instr in;
+    in.op = found->second;
+
+    // pseudo instruction
+    if (op == "nop")
+    {
+        return in; // sll $zero, $zero, 0
+    }
+    if (op == "move")
+    {
+        string rd, rs;
+        if (!(iss >> rd >> rs))
+            throw runtime_error("Invalid format for move: move $rd, $rs");
+        in.rd = regIndex(rd, instruction);
+        in.rs = regIndex(rs, instruction);
+        return in;
+    }
+    if (op == "b" || op == "beqz" || op == "bnez")
+    {
+        string rs_str = "$zero", offset_str;
+        if (op != "b" && !(iss >> rs_str))
+            throw runtime_error("Missing register in " + instruction);
+        if (!(iss >> offset_str))
+            throw runtime_error("Missing target in " + instruction);
+        in.rs = regIndex(rs_str, instruction);
+        in.imm = branchTarget(offset_str, prog, index, true);
+        return in;
+    }
+
+    switch (in.op)
+    {
+    // คำสั่งประเภท jump (J, Jal , Jr) และคำสั่งที่ใช้ register ตัวเดียว (mthi, mtlo)
+    case OP_JR:
+    case OP_MTHI:
+    case OP_MTLO:
+    {
+        string rs;
+        if (!(iss >> rs))
+        {
+            throw runtime_error("Missing register in " + instruction);
+        }
+        in.rs = regIndex(rs, instruction);
+        break;
+    }
+    case OP_MFHI:
+    case OP_MFLO:
+    {
+        string rd;
+        if (!(iss >> rd))
+            throw runtime_error("Missing register in " + instruction);
+        in.rd = regIndex(rd, instruction);
+        break;
+    }
+    // jalr $rs (เก็บ return address ลง $ra) หรือ jalr $rd, $rs
+    case OP_JALR:
+    {
+        string first, second;
+        if (!(iss >> first))
+            throw runtime_error("Missing register in " + instruction);
+        if (iss >> second)
+        {
+            in.rd = regIndex(first, instruction);
+            in.rs = regIndex(second, instruction);
+        }
+        else
+        {
+            in.rd = 31;
+            in.rs = regIndex(first, instruction);
+        }
+        break;
+    }
+    case OP_J:
+    case OP_JAL:
+    {
+        string target_str;
+        if (!(iss >> target_str))
+        {
+            throw runtime_error("Invalid jump format: " + instruction);
+        }
+        in.imm = branchTarget(target_str, prog, index, false);
+        break;
+    }
+
+    // คำสั่งประเภท branch (BEQ, BNE)
+    case OP_BEQ:
+    case OP_BNE:
+    {
+        string rs_str, rt_str, offset_str;
+        if (!(iss >> rs_str >> rt_str >> offset_str))
+        {
+            throw runtime_error("Invalid " + op + " format: " + op + " $rs, $rt, offset");
+        }
+        in.rs = regIndex(rs_str, instruction);
+        in.rt = regIndex(rt_str, instruction);
+        in.imm = branchTarget(offset_str, prog, index, true);
+        break;
+    }
+
+    // branch ที่เทียบกับ 0 (bltz, bgez, blez, bgtz, bltzal, bgezal) รูปแบบ op $rs, offset
+    case OP_BLTZ:
+    case OP_BGEZ:
+    case OP_BLEZ:
+    case OP_BGTZ:
+    case OP_BLTZAL:
+    case OP_BGEZAL:
+    {
+        string rs_str, offset_str;
+        if (!(iss >> rs_str >> offset_str))
+            throw runtime_error("Invalid " + op + " format: " + op + " $rs, offset");
+        in.rs = regIndex(rs_str, instruction);
+        in.imm = branchTarget(offset_str, prog, index, true);
+        break;
+    }
+
+    // คำสั่ง Load Immediate (LI, LA, LUI)
+    case OP_LI:
+    {
+        string rt_str, imm_str;
+        if (!(iss >> rt_str >> imm_str))
+        {
+            throw runtime_error("Invalid LI: " + instruction);
+        }
+        in.rt = regIndex(rt_str, instruction);
+        in.imm = immediate(imm_str, prog);
+        if (op == "lui")
+            in.imm = (int32_t)((uint32_t)in.imm << 16);
+        break;
+    }
+
+    // คำสั่ง Load/Store (LW , Sw, LL, SC, LB, LBU, LH, LHU, SB, SH) รูปแบบ offset($rs)
+    case OP_LW:
+    case OP_SW:
+    case OP_LL:
+    case OP_SC:
+    case OP_LB:
+    case OP_LBU:
+    case OP_LH:
+    case OP_LHU:
+    case OP_SB:
+    case OP_SH:
+    {
+        string rt_str, offset_rs;
+        if (!(iss >> rt_str))
+            throw runtime_error("Missing destination register in " + instruction);
+        getline(iss >> ws, offset_rs);
+        size_t open_paren = offset_rs.find('('), close_paren = offset_rs.find(')');
+        if (open_paren == string::npos || close_paren == string::npos)
+            throw runtime_error("Invalid format for " + op);
+        string offset_str = offset_rs.substr(0, open_paren);
+        string rs_str = offset_rs.substr(open_paren + 1, close_paren - open_paren - 1);
+        in.rt = regIndex(rt_str, instruction);
+        in.rs = regIndex(rs_str, instruction);
+        in.imm = offset_str.empty() ? 0 : parseImm(offset_str); // "($t1)" = offset 0
+        break;
+    }
+
+    // shift ด้วยค่าคงที่ รูปแบบ op $rd, $rt, shamt
+    case OP_SLL:
+    case OP_SRL:
+    case OP_SRA:
+    {
+        string rd, rt, shamt;
+        if (!(iss >> rd >> rt >> shamt))
+            throw runtime_error("Invalid format for " + op + ": " + op + " $rd, $rt, shamt");
+        in.rd = regIndex(rd, instruction);
+        in.rt = regIndex(rt, instruction);
+        in.imm = parseImm(shamt);
+        if (in.imm < 0 || in.imm > 31)
+            throw runtime_error("Shift amount out of range in " + instruction);
+        break;
+    }
+
+    // shift ด้วยค่าใน register รูปแบบ op $rd, $rt, $rs (ค่าที่ shift มาก่อนจำนวนบิต)
+    case OP_SLLV:
+    case OP_SRLV:
+    case OP_SRAV:
+    {
+        string rd, rt, rs;
+        if (!(iss >> rd >> rt >> rs))
+            throw runtime_error("Invalid format for " + op + ": " + op + " $rd, $rt, $rs");
+        in.rd = regIndex(rd, instruction);
+        in.rt = regIndex(rt, instruction);
+        in.rs = regIndex(rs, instruction);
+        break;
+    }
+
+    // คำสั่งที่ใช้ hi/lo (mult, div, madd, ...) และ teq รูปแบบ op $rs, $rt
+    case OP_MULT:
+    case OP_MULTU:
+    case OP_DIV:
+    case OP_DIVU:
+    case OP_MADD:
+    case OP_MADDU:
+    case OP_MSUB:
+    case OP_MSUBU:
+    case OP_TEQ:
+    {
+        string rs, rt;
+        if (!(iss >> rs >> rt))
+            throw runtime_error("Invalid format for " + op + ": " + op + " $rs, $rt");
+        in.rs = regIndex(rs, instruction);
+        in.rt = regIndex(rt, instruction);
+        break;
+    }
+
+    // clz/clo รูปแบบ op $rd, $rs
+    case OP_CLZ:
+    case OP_CLO:
+    {
+        string rd, rs;
+        if (!(iss >> rd >> rs))
+            throw runtime_error("Invalid format for " + op + ": " + op + " $rd, $rs");
+        in.rd = regIndex(rd, instruction);
+        in.rs = regIndex(rs, instruction);
+        break;
+    }
+
+    // คำสั่งประเภท I ที่ใช้ค่าคงที่ (addi, addiu, slti, sltiu, andi, ori, xori) รูปแบบ op $rt, $rs, imm
+    case OP_ADDI:
+    case OP_ADDIU:
+    case OP_SLTI:
+    case OP_SLTIU:
+    case OP_ANDI:
+    case OP_ORI:
+    case OP_XORI:
+    {
+        string rt, rs, imm;
+        if (!(iss >> rt >> rs >> imm))
+            throw runtime_error("Invalid format for " + op + ": " + op + " $rt, $rs, imm");
+        in.rt = regIndex(rt, instruction);
+        in.rs = regIndex(rs, instruction);
+        in.imm = immediate(imm, prog);
+        break;
+    }
+
+    // คำสั่งประเภท R (add, sub, mul, and, or, slt, ...) รูปแบบ op $rd $rs $rt
+    default:
+    {
+        string rd, rs, rt;
+        if (!(iss >> rd >> rs >> rt))
+            throw runtime_error("Invalid format for " + op);
+        in.rd = regIndex(rd, instruction);
+        in.rs = regIndex(rs, instruction);
+        in.rt = regIndex(rt, instruction);
+        break;
+    }
+    }
+    return in;
+}
+
+// ถอดรหัสทั้งโปรแกรม บรรทัดว่างจะถูกข้าม คำสั่งที่ i อยู่ที่ PC = i * 4
+vector<Instr> CPU::decodeProgram(const vector<string> &lines)
+{
+    return assemble(lines).code;
+}
+
+// ตัด comment (#) ออก ยกเว้น # ที่อยู่ใน "..." ของ .asciiz
+static string stripComment(const string &line)
+{
+    bool quoted = false;
+    for (size_t i = 0; i < line.size(); i++)
+    {
+        if (line[i] == '"' && (i == 0 || line[i - 1] != '\\'))
+            quoted = !quoted;
+        else if (line[i] == '#' && !quoted)
+            return line.substr(0, i);
+    }
+    return line;
+}
+
+// อ่าน string ใน "..." ของ .ascii/.asciiz รองรับ \n \t \0 \\ \"
+static string parseString(const string &text)
+{
+    size_t open = text.find('"'), close = text.rfind('"');
+    if (open == string::npos || close == open)
+        throw runtime_error("Invalid string: " + text);
+    string out;
+    for (size_t i = open + 1; i < close; i++)
+    {
+        char c = text[i];
+        if (c == '\\' && i + 1 < close)
+        {
+            c = text[++i];
+            c = c == 'n' ? '\n' : c == 't' ? '\t' : c == '0' ? '\0' : c;
+        }
+        out += c;
+    }
+    return out;
+}
+
+/*  Assembler แบบ 2 pass
+    pass 1: ตัด comment (#), เก็บตำแหน่ง label ("loop:") ใน text เป็น word address
+            ส่วน .data (เริ่มที่ 0x10010000) รองรับ .word .half .byte .space .align .ascii .asciiz
+            label ใน .data เก็บเป็น byte address directive อื่นๆ (.globl, ...) ข้ามไป
+    pass 2: ถอดรหัสทุกคำสั่ง ตอนนี้รู้ตำแหน่ง label ครบแล้วเลยกระโดดไปข้างหน้าได้ และใส่ address ของ label ใน .word
+*/
+Program CPU::assemble(const vector<string> &lines)
+{
+    const uint32_t DATA_BASE = 0x10010000;
+
+    Program prog;
+    vector<string> text;                       // คำสั่งที่เหลือหลังตัด label/comment แล้ว
+    Segment data;                              // ข้อมูลใน .data
+    data.addr = DATA_BASE;
+    vector<pair<size_t, string>> word_labels;  // .word ที่เป็นชื่อ label (ตำแหน่งใน data, label) ใส่ค่าตอน pass 2
+    bool in_data = false;
+
+    auto align = [&](size_t bytes)
+    {
+        while (data.bytes.size() % bytes != 0)
+            data.bytes.push_back(0);
+    };
+    auto emit = [&](uint32_t value, int size) // เขียนแบบ little endian
+    {
+        for (int b = 0; b < size; b++)
+            data.bytes.push_back((uint8_t)(value >> (8 * b)));
+    };
+
+    // pass 1
+    for (size_t n = 0; n < lines.size(); n++)
+    {
+        string line = stripComment(lines[n]);
+        string where = "line " + to_string(n + 1) + ": ";
+
+        vector<string> line_labels;
+        size_t colon;
+        while ((colon = line.find(':')) != string::npos && colon < line.find('"')) // label อาจมีคำสั่งต่อท้ายในบรรทัดเดียวกัน เช่น "loop: add $t0 $t0 $t1"
+        {
+            string label = line.substr(0, colon);
+            label.erase(0, label.find_first_not_of(" \t"));
+            label.erase(label.find_last_not_of(" \t\r") + 1);
+            if (label.empty() || label.find_first_of(" \t$(") != string::npos)
+            {
+                throw runtime_error(where + "Invalid label: " + label);
+            }
+            if (prog.labels.count(label) || prog.data_labels.count(label))
+            {
+                throw runtime_error(where + "Duplicate label: " + label);
+            }
+            line_labels.push_back(label);
+            line = line.substr(colon + 1);
+        }
+
+        istringstream iss(line);
+        string directive;
+        iss >> directive;
+        if (directive == ".data" || directive == ".text")
+        {
+            in_data = directive == ".data";
+            directive.clear();
+        }
+
+        if (in_data)
+        {
+            try
+            {
+                string rest;
+                getline(iss, rest);
+                replace(rest.begin(), rest.end(), ',', ' ');
+                istringstream values(rest);
+                string value;
+
+                // label ชี้ไปที่ข้อมูลหลังจัด alignment แล้ว
+                if (directive == ".word")
+                    align(4);
+                else if (directive == ".half")
+                    align(2);
+                else if (directive == ".align")
+                {
+                    int n = parseImm(rest.substr(rest.find_first_not_of(" \t")));
+                    if (n < 0 || n > 31) // 1u << n เกิน 31 ไม่มีความหมาย (undefined)
+                        throw runtime_error(".align must be 0..31: " + to_string(n));
+                    align(1u << n);
+                }
+                for (const string &label : line_labels)
+                    prog.data_labels[label] = DATA_BASE + (uint32_t)data.bytes.size();
+
+                if (directive == ".word")
+                {
+                    while (values >> value)
+                    {
+                        if (isdigit((unsigned char)value[0]) || value[0] == '-' || value[0] == '+')
+                        {
+                            emit((uint32_t)parseImm(value), 4);
+                        }
+                        else
+                        {
+                            word_labels.push_back({data.bytes.size(), value});
+                            emit(0, 4);
+                        }
+                    }
+                }
+                else if (directive == ".half" || directive == ".byte")
+                {
+                    while (values >> value)
+                        emit((uint32_t)parseImm(value), directive == ".half" ? 2 : 1);
+                }
+                else if (directive == ".space")
+                {
+                    int size = parseImm(rest.substr(rest.find_first_not_of(" \t")));
+                    if (size < 0)
+                        throw runtime_error(".space size must not be negative: " + to_string(size));
+                    if ((uint64_t)data.bytes.size() + (uint32_t)size > Memory::USER_LIMIT - DATA_BASE) // ต้องไม่เกินพื้นที่ของโปรแกรม
+                        throw runtime_error(".space does not fit below 0x80000000: " + to_string(size));
+                    data.bytes.resize(data.bytes.size() + (size_t)size, 0);
+                }
+                else if (directive == ".ascii" || directive == ".asciiz")
+                {
+                    string str = parseString(line);
+                    data.bytes.insert(data.bytes.end(), str.begin(), str.end());
+                    if (directive == ".asciiz")
+                        data.bytes.push_back(0);
+                }
+                else if (!directive.empty() && directive != ".align" && directive[0] != '.')
+                {
+                    throw runtime_error("Instruction in .data section: " + directive);
+                }
+            }
+            catch (const exception &e)
+            {
+                throw runtime_error(where + e.what());
+            }
+            continue;
+        }
+
+        for (const string &label : line_labels)
+            prog.labels[label] = (int)text.size();
+        if (directive.empty() || directive[0] == '.') // บรรทัดว่าง หรือ directive
+            continue;
+        text.push_back(line);
+        prog.source_line.push_back((int)n + 1);
+    }
+
+    // pass 2
+    prog.code.reserve(text.size());
+    for (size_t i = 0; i < text.size(); i++)
+    {
+        try
+        {
+            prog.code.push_back(decode(text[i], &prog, (int)i));
+        }
+        catch (const exception &e)
+        {
+            throw runtime_error("line " + to_string(prog.source_line[i]) + ": " + e.what());
+        }
+    }
+    for (const auto &fix : word_labels)
+    {
+        uint32_t value = (uint32_t)immediate(fix.second, &prog);
+        for (int b = 0; b < 4; b++)
+            data.bytes[fix.first + b] = (uint8_t)(value >> (8 * b));
+    }
+    if (!data.bytes.empty())
+        prog.data.push_back(move(data));
+    return prog;
+}
+
+Program CPU::loadProgram(const string &path)
+{
+    ifstream file(path);
+    if (!file)
+    {
+        throw runtime_error("Cannot open file: " + path);
+    }
+    vector<string> lines;
+    string line;
+    while (getline(file, line))
+    {
+        lines.push_back(line);
+    }
+    return assemble(lines);
+}
+
+// อ่านเลข 16/32 bit จาก byte ตาม endian ของไฟล์
+static uint32_t readU32(const uint8_t *p, bool big_endian)
+{
+    return big_endian ? ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3]
+                      : ((uint32_t)p[3] << 24) | ((uint32_t)p[2] << 16) | ((uint32_t)p[1] << 8) | p[0];
+}
+
+static uint16_t readU16(const uint8_t *p, bool big_endian)
+{
+    return big_endian ? (uint16_t)((p[0] << 8) | p[1]) : (uint16_t)((p[1] << 8) | p[0]);
+}
+
+/*  ถอดรหัส machine code MIPS32 ด้วย shift/mask แล้วจับคู่กับคำสั่งใน initInstructionMap
+    R format: opcode(6) rs(5) rt(5) rd(5) shamt(5) funct(6)
+    I format: opcode(6) rs(5) rt(5) imm(16)
+    J format: opcode(6) target(26)
+    คำสั่งที่ไม่มีใน simulator ได้ OP_INVALID
+    simulator ไม่มี branch delay slot: binary ต้อง compile แบบ -fno-delayed-branch (ช่อง delay slot เป็น nop)
+*/
+Instr CPU::decodeWord(uint32_t word, uint32_t pc)
+{
+    Instr in;
+    uint32_t opcode = word >> 26;
+    in.rs = (word >> 21) & 31;
+    in.rt = (word >> 16) & 31;
+    in.rd = (word >> 11) & 31;
+    uint32_t shamt = (word >> 6) & 31;
+    uint32_t funct = word & 63;
+    int32_t simm = (int16_t)(word & 0xFFFF); // sign-extend 16 bit
+    uint32_t uimm = word & 0xFFFF;
+
+    switch (opcode)
+    {
+    case 0x00: // SPECIAL (R format) เลือกคำสั่งจาก funct
+        switch (funct)
+        {
+        case 0x00: in.op = OP_SLL; break; // sll $0, $0, 0 = nop
+        case 0x02: in.op = OP_SRL; break;
+        case 0x03: in.op = OP_SRA; break;
+        case 0x04: in.op = OP_SLLV; break;
+        case 0x06: in.op = OP_SRLV; break;
+        case 0x07: in.op = OP_SRAV; break;
+        case 0x08: in.op = OP_JR; break;
+        case 0x09: in.op = OP_JALR; break;
+        case 0x0A: in.op = OP_MOVZ; break;
+        case 0x0B: in.op = OP_MOVN; break;
+        case 0x10: in.op = OP_MFHI; break;
+        case 0x11: in.op = OP_MTHI; break;
+        case 0x12: in.op = OP_MFLO; break;
+        case 0x13: in.op = OP_MTLO; break;
+        case 0x18: in.op = OP_MULT; break;
+        case 0x19: in.op = OP_MULTU; break;
+        case 0x1A: in.op = OP_DIV; break;
+        case 0x1B: in.op = OP_DIVU; break;
+        case 0x20: in.op = OP_ADD; break;
+        case 0x21: in.op = OP_ADDU; break;
+        case 0x22: in.op = OP_SUB; break;
+        case 0x23: in.op = OP_SUBU; break;
+        case 0x24: in.op = OP_AND; break;
+        case 0x25: in.op = OP_OR; break;
+        case 0x26: in.op = OP_XOR; break;
+        case 0x27: in.op = OP_NOR; break;
+        case 0x2A: in.op = OP_SLT; break;
+        case 0x2B: in.op = OP_SLTU; break;
+        case 0x34: in.op = OP_TEQ; break;
+        default: in.op = OP_INVALID; break;
+        }
+        if (in.op == OP_SLL || in.op == OP_SRL || in.op == OP_SRA)
+            in.imm = (int32_t)shamt;
+        break;
+    case 0x1C: // SPECIAL2
+        switch (funct)
+        {
+        case 0x00: in.op = OP_MADD; break;
+        case 0x01: in.op = OP_MADDU; break;
+        case 0x02: in.op = OP_MUL; break;
+        case 0x04: in.op = OP_MSUB; break;
+        case 0x05: in.op = OP_MSUBU; break;
+        case 0x20: in.op = OP_CLZ; break;
+        case 0x21: in.op = OP_CLO; break;
+        default: in.op = OP_INVALID; break;
+        }
+        break;
+    case 0x01: // REGIMM เลือกคำสั่งจาก rt
+        switch (in.rt)
+        {
+        case 0x00: in.op = OP_BLTZ; break;
+        case 0x01: in.op = OP_BGEZ; break;
+        case 0x10: in.op = OP_BLTZAL; break;
+        case 0x11: in.op = OP_BGEZAL; break;
+        default: in.op = OP_INVALID; break;
+        }
+        in.rt = 0;
+        in.imm = simm;
+        break;
+    case 0x02: // j
+    case 0x03: // jal   target = 4 bit บนของ (PC + 4) ต่อกับ target 26 bit (เป็น word address)
+        in.op = (opcode == 0x02) ? OP_J : OP_JAL;
+        in.imm = (int32_t)((((pc + 4) & 0xF0000000u) >> 2) | (word & 0x03FFFFFF));
+        break;
+    case 0x04: // beq  offset นับจาก PC + 4 เหมือนกับ OP_BEQ เลย
+    case 0x05: // bne
+        in.op = (opcode == 0x04) ? OP_BEQ : OP_BNE;
+        in.imm = simm;
+        break;
+    case 0x06: // blez
+    case 0x07: // bgtz
+        in.op = (opcode == 0x06) ? OP_BLEZ : OP_BGTZ;
+        in.imm = simm;
+        break;
+    case 0x20: in.op = OP_LB; in.imm = simm; break;
+    case 0x21: in.op = OP_LH; in.imm = simm; break;
+    case 0x23: in.op = OP_LW; in.imm = simm; break;
+    case 0x24: in.op = OP_LBU; in.imm = simm; break;
+    case 0x25: in.op = OP_LHU; in.imm = simm; break;
+    case 0x28: in.op = OP_SB; in.imm = simm; break;
+    case 0x29: in.op = OP_SH; in.imm = simm; break;
+    case 0x2B: in.op = OP_SW; in.imm = simm; break;
+    case 0x30: in.op = OP_LL; in.imm = simm; break;
+    case 0x38: in.op = OP_SC; in.imm = simm; break;
+    case 0x08: in.op = OP_ADDI; in.imm = simm; break;
+    case 0x09: // addiu / ori ที่ rs = $zero คือ li rt, imm (ไม่ต้องอ่าน register)
+        in.op = (in.rs == 0) ? OP_LI : OP_ADDIU;
+        in.imm = simm;
+        break;
+    case 0x0A: in.op = OP_SLTI; in.imm = simm; break;
+    case 0x0B: in.op = OP_SLTIU; in.imm = simm; break; // เทียบกับ imm ที่ sign-extend แล้วแบบ unsigned
+    case 0x0C: in.op = OP_ANDI; in.imm = (int32_t)uimm; break;
+    case 0x0D:
+        in.op = (in.rs == 0) ? OP_LI : OP_ORI;
+        in.imm = (int32_t)uimm;
+        break;
+    case 0x0E: in.op = OP_XORI; in.imm = (int32_t)uimm; break;
+    case 0x0F: // lui rt, imm คือ li rt, imm << 16
+        in.op = OP_LI;
+        in.imm = (int32_t)(uimm << 16);
+        break;
+    default:
+        in.op = OP_INVALID;
+        break;
+    }
+    if (in.op == OP_INVALID)
+        in.imm = (int32_t)word; // เก็บ word เดิมไว้ใช้ตอนแจ้ง error
+    return in;
+}
+
+/*  โหลดไฟล์ machine code
+    - ถ้าขึ้นต้นด้วย 0x7F 'E' 'L' 'F' จะอ่านเป็น ELF32: PT_LOAD ที่ execute ได้ (PF_X) เป็น text ส่วนอื่นเป็น data
+      endian อ่านจาก header ของไฟล์เอง
+    - ไม่อย่างนั้นเป็น flat binary: ทั้งไฟล์คือ text วางที่ base, entry = base
+*/
+Program CPU::loadBinary(const string &path, uint32_t base, bool big_endian)
+{
+    MappedFile file(path);
+    const uint8_t *bytes = file.data;
+    Program prog;
+    prog.code_in_memory = true;
+
+    /*  segment ที่ต้องเขียนลง memory (text ก็อยู่ใน memory ด้วย lw อ่าน constant ใน text ได้ sw เขียนทับคำสั่งได้)
+        memory ของ simulator เป็น little endian: ไฟล์ big endian ต้องสลับ byte ทีละ word ให้ lw ได้ค่าเดิม
+    */
+    auto addSegment = [&](const uint8_t *data, size_t filesz, size_t memsz, uint32_t addr, bool be)
+    {
+        Segment seg;
+        seg.addr = addr;
+        seg.bytes.assign(data, data + filesz);
+        seg.bytes.resize(memsz, 0); // .bss
+        if (be)
+        {
+            for (size_t b = 0; b + 4 <= seg.bytes.size(); b += 4)
+            {
+                swap(seg.bytes[b], seg.bytes[b + 3]);
+                swap(seg.bytes[b + 1], seg.bytes[b + 2]);
+            }
+        }
+        prog.data.push_back(move(seg));
+    };
+
+    // ถอดรหัส text ทีละ word (ไม่มีการ parse string เลย)
+    auto decodeText = [&](const uint8_t *text, size_t size, uint32_t addr, bool be)
+    {
+        if (!prog.code.empty())
+            throw runtime_error("Only one executable segment is supported: " + path);
+        prog.text_base = addr;
+        prog.code.resize(size / 4);
+        for (size_t i = 0; i < size / 4; i++)
+        {
+            prog.code[i] = decodeWord(readU32(text + i * 4, be), addr + (uint32_t)i * 4);
+        }
+        addSegment(text, size, size, addr, be);
+    };
+
+    if (file.size >= 4 && memcmp(bytes, "\x7F" "ELF", 4) == 0)
+    {
+        if (file.size < 52 || bytes[4] != 1) // EI_CLASS = 1 คือ 32 bit
+            throw runtime_error("Not an ELF32 file: " + path);
+        bool be = bytes[5] == 2; // EI_DATA: 1 = little endian, 2 = big endian
+        if (readU16(bytes + 18, be) != 8) // e_machine = EM_MIPS
+            throw runtime_error("Not a MIPS ELF file: " + path);
+
+        prog.entry = readU32(bytes + 24, be);
+        uint32_t phoff = readU32(bytes + 28, be);
+        uint16_t phentsize = readU16(bytes + 42, be);
+        uint16_t phnum = readU16(bytes + 44, be);
+
+        for (uint16_t i = 0; i < phnum; i++)
+        {
+            size_t ph = (size_t)phoff + (size_t)i * phentsize;
+            if (ph + 32 > file.size)
+                throw runtime_error("Truncated program header: " + path);
+            const uint8_t *h = bytes + ph;
+            if (readU32(h, be) != 1) // PT_LOAD เท่านั้น
+                continue;
+            uint32_t offset = readU32(h + 4, be);
+            uint32_t vaddr = readU32(h + 8, be);
+            uint32_t filesz = readU32(h + 16, be);
+            uint32_t memsz = readU32(h + 20, be);
+            uint32_t flags = readU32(h + 24, be);
+            if ((size_t)offset + filesz > file.size || filesz > memsz)
+                throw runtime_error("Invalid segment in " + path);
+
+            if (flags & 1) // PF_X
+                decodeText(bytes + offset, filesz, vaddr, be);
+            else
+                addSegment(bytes + offset, filesz, memsz, vaddr, be);
+        }
+        if (prog.code.empty())
+            throw runtime_error("No executable segment in " + path);
+    }
+    else
+    {
+        if (file.size % 4 != 0)
+            throw runtime_error("Binary size is not a multiple of 4 bytes: " + path);
+        decodeText(bytes, file.size, base, big_endian);
+        prog.entry = base;
+    }
+    return prog;
+}
+
+/*  เตรียม CPU ให้พร้อมรันโปรแกรม: PC = entry แล้ว copy segment ลง memory (byte address)
+    ตั้ง $sp / $gp ตามค่าเริ่มต้นของ MIPS (stack โตลงจากใต้ 0x80000000, global data ที่ 0x10008000)
+*/
+void CPU::load(const Program &prog, bool write_memory)
+{
+    PC = (int)prog.entry;
+    code = prog.code.data();
+    code_base = prog.text_base;
+    code_count = (uint32_t)prog.code.size();
+    code_watch = prog.code_in_memory ? code_count * 4 : 0;
+    private_code.clear();
+    code_writes.clear();
+    block_of.assign(code_count, -1);
+    blocks.clear();
+    free_blocks.clear();
+
+    registers[28] = 0x10008000;  // $gp
+    registers[29] = 0x7FFFEFFC;  // $sp
+    link_valid = false;
+    if (!write_memory) // memory ใช้ร่วมกับ core อื่นที่ load ไปแล้ว
+        return;
+    for (const Segment &seg : prog.data)
+    {
+        memory.writeBytes(seg.addr, seg.bytes.data(), seg.bytes.size());
+    }
+}
+
+void CPU::reset()
+{
+    fill(begin(registers), end(registers), 0);
+    hi = lo = 0;
+    PC = 0;
+    memory = Memory();
+    link_valid = false;
+}
+
+/*  execute คำสั่งที่ถอดรหัสแล้ว 1 คำสั่ง
+    PC จะถูกเลื่อนไปคำสั่งถัดไป (PC + 4) ก่อนทำคำสั่ง เหมือน MIPS จริง
+    เพราะงั้น branch จะกระโดดไปที่ (PC + 4) + offset*4 และ jal จะเก็บ PC + 4 ของคำสั่ง jal ลง $ra
+*/
+SIM_INLINE void CPU::step(const Instr &in)
+{
+    PC += 4;
+    exec(in.op, in);
+}
+
+// target ของ branch: PC (ที่เลื่อนไปแล้ว) + offset * 4 คิดแบบ unsigned ให้ wrap ได้เหมือน hardware
+static SIM_INLINE int branchPC(int pc, int32_t offset)
+{
+    return (int)((uint32_t)pc + ((uint32_t)offset << 2));
+}
+
+// exception ของคำสั่งที่อยู่ที่ PC - 4 (PC ถูกเลื่อนไปแล้ว)
+void CPU::trap(const char *what)
+{
+    ostringstream msg;
+    msg << what << " at PC 0x" << hex << (uint32_t)(PC - 4);
+    throw runtime_error(msg.str());
+}
+
+/*  ทำงานของคำสั่ง op (PC ถูกเลื่อนไปแล้ว) แยก op ออกมาจาก in เพื่อให้ threaded code ส่ง op เป็นค่าคงที่ได้ compiler จะตัด switch ทิ้ง
+    เลขคณิตทั้งหมดคิดแบบ uint32_t (wrap แบบ 2's complement ไม่มี signed overflow) ยกเว้น add/sub/addi ที่ trap ถ้า overflow
+*/
+SIM_INLINE void CPU::exec(uint8_t op, const Instr &in)
+{
+    uint32_t rs = (uint32_t)registers[in.rs];
+    uint32_t rt = (uint32_t)registers[in.rt];
+    switch (op)
+    {
+    // บวก add $t0, $t1, $t2 [$t0 = $t1 + $t2] ถ้าผลเกิน 32 bit แบบมีเครื่องหมายจะ trap (addu ไม่ trap)
+    case OP_ADD:
+    {
+        int64_t sum = (int64_t)(int32_t)rs + (int32_t)rt;
+        if (sum != (int32_t)sum)
+            trap("Integer overflow in add");
+        registers[in.rd] = (int)sum;
+        break;
+    }
+    case OP_ADDU:
+        registers[in.rd] = (int)(rs + rt);
+        break;
+
+    // ลบ sub $t0, $t1, $t2 [$t0 = $t1 - $t2] trap ถ้า overflow (subu ไม่ trap)
+    case OP_SUB:
+    {
+        int64_t diff = (int64_t)(int32_t)rs - (int32_t)rt;
+        if (diff != (int32_t)diff)
+            trap("Integer overflow in sub");
+        registers[in.rd] = (int)diff;
+        break;
+    }
+    case OP_SUBU:
+        registers[in.rd] = (int)(rs - rt);
+        break;
+
+    // คูณ mul $t0, $t1, $t2 [$t0 = 32 bit ล่างของ $t1 * $t2]
+    case OP_MUL:
+        registers[in.rd] = (int)(rs * rt);
+        break;
+
+    /*  คูณ/หารที่เก็บผลลง hi/lo
+        mult/multu $rs, $rt [hi:lo = $rs * $rt (64 bit)]
+        div/divu $rs, $rt [lo = $rs / $rt, hi = $rs % $rt] หารด้วย 0 ไม่มีผล (MIPS ไม่กำหนดค่า compiler จะใส่ teq ไว้ดักก่อน)
+        madd/msub $rs, $rt [hi:lo +=/-= $rs * $rt]
+    */
+    case OP_MULT:
+    {
+        uint64_t product = (uint64_t)((int64_t)(int32_t)rs * (int32_t)rt);
+        hi = (int)(uint32_t)(product >> 32);
+        lo = (int)(uint32_t)product;
+        break;
+    }
+    case OP_MULTU:
+    {
+        uint64_t product = (uint64_t)rs * rt;
+        hi = (int)(uint32_t)(product >> 32);
+        lo = (int)(uint32_t)product;
+        break;
+    }
+    case OP_DIV:
+        if (rt != 0)
+        {
+            if ((int32_t)rs == INT32_MIN && (int32_t)rt == -1) // ผลหารเกิน int32: hardware ได้ lo = INT32_MIN, hi = 0
+            {
+                lo = INT32_MIN;
+                hi = 0;
+            }
+            else
+            {
+                lo = (int32_t)rs / (int32_t)rt;
+                hi = (int32_t)rs % (int32_t)rt;
+            }
+        }
+        break;
+    case OP_DIVU:
+        if (rt != 0)
+        {
+            lo = (int)(rs / rt);
+            hi = (int)(rs % rt);
+        }
+        break;
+    case OP_MADD:
+    case OP_MADDU:
+    case OP_MSUB:
+    case OP_MSUBU:
+    {
+        uint64_t acc = ((uint64_t)(uint32_t)hi << 32) | (uint32_t)lo;
+        uint64_t product = (op == OP_MADD || op == OP_MSUB) ? (uint64_t)((int64_t)(int32_t)rs * (int32_t)rt) : (uint64_t)rs * rt;
+        acc = (op == OP_MADD || op == OP_MADDU) ? acc + product : acc - product;
+        hi = (int)(uint32_t)(acc >> 32);
+        lo = (int)(uint32_t)acc;
+        break;
+    }
+    case OP_MFHI:
+        registers[in.rd] = hi;
+        break;
+    case OP_MFLO:
+        registers[in.rd] = lo;
+        break;
+    case OP_MTHI:
+        hi = (int)rs;
+        break;
+    case OP_MTLO:
+        lo = (int)rs;
+        break;
+
+    /*  Load Word โหลดข้อมูลจาก Memory registers
+        lw $t0, offset($t1) [$t0 = memory[$t1 + offset]]
+        $t0: รีจิสเตอร์ที่ใช้เก็บข้อมูล
+        memory[$t1 + offset]:  ที่อยู่ในหน่วยความจำที่ต้องการโหลดข้อมูลมา ($t1 และ offset เป็นเลข byte ทั้งคู่ ต้องหาร 4 ลงตัว)
+        lb/lh โหลด 1/2 byte แบบ sign-extend, lbu/lhu แบบ zero-extend (lh/lhu address ต้องหาร 2 ลงตัว)
+    */
+    case OP_LW:
+    case OP_LB:
+    case OP_LBU:
+    case OP_LH:
+    case OP_LHU:
+    {
+        uint32_t addr = rs + (uint32_t)in.imm;
+        int value;
+        if (op == OP_LW)
+            value = (int)memory.read32(addr);
+        else if (op == OP_LB)
+            value = (int8_t)memory.read8(addr);
+        else if (op == OP_LBU)
+            value = memory.read8(addr);
+        else if (op == OP_LH)
+            value = (int16_t)memory.read16(addr);
+        else
+            value = memory.read16(addr);
+        registers[in.rt] = value;
+        if (caches)
+            caches->data(addr, false);
+        SIM_PROFILE_HOOK(profile, load(addr));
+        break;
+    }
+
+    /*  Store Word ใช้ในการเก็บค่าจาก register ลง Memory
+        sw $t0, offset($s1) [[$s1 + offset] = $t0]
+        เก็บค่าใน $t0 ลง memory[$s1 + offset]
+        memory[$s1 + offset]:  ที่อยู่ในหน่วยความจำที่ต้องการ save ($s1 และ offset เป็นเลข byte ทั้งคู่ ต้องหาร 4 ลงตัว)
+        sb/sh เก็บแค่ 8/16 bit ล่างของ $t0
+    */
+    case OP_SW:
+    case OP_SB:
+    case OP_SH:
+    {
+        uint32_t addr = rs + (uint32_t)in.imm;
+        if (op == OP_SW)
+            memory.write32(addr, rt);
+        else if (op == OP_SB)
+            memory.write8(addr, (uint8_t)rt);
+        else
+            memory.write16(addr, (uint16_t)rt);
+        if (caches)
+            caches->data(addr, true);
+        SIM_PROFILE_HOOK(profile, store(addr));
+        if (addr - code_base < code_watch) // เขียนทับคำสั่งของโปรแกรม (เฉพาะไฟล์ binary)
+            writeCode(addr);
+        break;
+    }
+
+    /*  Load Linked / Store Conditional ใช้ทำ atomic (lock) ระหว่างหลาย core
+        ll $t0, offset($s0) เหมือน lw แต่จำ address และค่าที่อ่านได้ไว้
+        sc $t0, offset($s0) เขียน $t0 ถ้าค่าใน memory ยังเท่ากับตอน ll (เช็คและเขียนแบบ atomic) แล้ว $t0 = 1 ถ้าสำเร็จ, 0 ถ้าไม่สำเร็จ
+        (เทียบกับค่าแทนการเฝ้า cache line เหมือน CPU จริง ไม่มี reservation: ถ้ามี core อื่นเขียน A -> B -> A ระหว่าง ll กับ sc
+         sc จะยังสำเร็จ (ปัญหา ABA) และ sw ธรรมดาของ core อื่นไม่ได้ยกเลิก ll ถ้าค่ายังเท่าเดิม)
+        sw ธรรมดาเขียน memory ตรงๆ ไม่ผ่าน compare-exchange ปนกับ sc ของ core อื่นได้เพราะ store 32 bit ที่ align แล้วของ host เป็น atomic
+    */
+    case OP_LL:
+    {
+        uint32_t addr = rs + (uint32_t)in.imm;
+        link_value = memory.read32(addr);
+        link_addr = addr;
+        link_valid = true;
+        registers[in.rt] = (int)link_value;
+        if (caches)
+            caches->data(addr, false);
+        SIM_PROFILE_HOOK(profile, load(addr));
+        break;
+    }
+    case OP_SC:
+    {
+        uint32_t addr = rs + (uint32_t)in.imm;
+        bool ok = link_valid && link_addr == addr && memory.compareExchange32(addr, link_value, rt);
+        link_valid = false;
+        registers[in.rt] = ok ? 1 : 0;
+        if (caches)
+            caches->data(addr, true);
+        SIM_PROFILE_HOOK(profile, store(addr));
+        if (ok && addr - code_base < code_watch)
+            writeCode(addr);
+        break;
+    }
+
+    /*  Load Immediate ใส่ค่าคงที่ลงใน register
+        li $t0, imm [$t0 = imm]
+    */
+    case OP_LI:
+        registers[in.rt] = in.imm;
+        break;
+
+    // คำสั่งประเภท I: ใช้ค่าคงที่แทน $rt เช่น addiu $t0, $t1, 4 [$t0 = $t1 + 4] (addi trap ถ้า overflow)
+    case OP_ADDI:
+    {
+        int64_t sum = (int64_t)(int32_t)rs + in.imm;
+        if (sum != (int32_t)sum)
+            trap("Integer overflow in addi");
+        registers[in.rt] = (int)sum;
+        break;
+    }
+    case OP_ADDIU:
+        registers[in.rt] = (int)(rs + (uint32_t)in.imm);
+        break;
+    case OP_SLTI:
+        registers[in.rt] = ((int32_t)rs < in.imm) ? 1 : 0;
+        break;
+    case OP_SLTIU:
+        registers[in.rt] = (rs < (uint32_t)in.imm) ? 1 : 0;
+        break;
+    case OP_ANDI:
+        registers[in.rt] = (int)(rs & (uint32_t)in.imm);
+        break;
+    case OP_ORI:
+        registers[in.rt] = (int)(rs | (uint32_t)in.imm);
+        break;
+    case OP_XORI:
+        registers[in.rt] = (int)(rs ^ (uint32_t)in.imm);
+        break;
+
+    /*  Branch if Equal กระโดดไปยังตำแหน่งอื่นของโปรแกรม หากค่าของรีจิสเตอร์สองตัวเท่ากัน
+        beq $rs, $rt, offset [if register[rs] == register[rt] กระโดดไปที่ PC + (offset*4)]
+        PC ใช้เป็น Byte Address offset เลย *4
+    */
+    case OP_BEQ:
+        SIM_PROFILE_HOOK(profile, branch(OP_BEQ, rs == rt));
+        if (rs == rt)
+        {
+            PC = branchPC(PC, in.imm);
+        }
+        break;
+
+    /*  Branch if Not Equal กระโดดไปยังตำแหน่งอื่นของโปรแกรม หากค่าของรีจิสเตอร์สองตัวไม่เท่ากัน
+        bne $rs, $rt, offset [if register[rs] != register[rt] กระโดดไปที่ PC + (offset*4)]
+        PC ใช้เป็น Byte Address offset เลย *4
+    */
+    case OP_BNE:
+        SIM_PROFILE_HOOK(profile, branch(OP_BNE, rs != rt));
+        if (rs != rt)
+        {
+            PC = branchPC(PC, in.imm);
+        }
+        break;
+
+    /*  branch ที่เทียบ $rs กับ 0 เช่น bltz $rs, offset [if register[rs] < 0 กระโดดไปที่ PC + (offset*4)]
+        bltzal/bgezal เก็บ PC + 4 ลง $ra เสมอไม่ว่าจะกระโดดหรือไม่
+    */
+    case OP_BLTZ:
+    case OP_BGEZ:
+    case OP_BLEZ:
+    case OP_BGTZ:
+    case OP_BLTZAL:
+    case OP_BGEZAL:
+    {
+        int32_t value = (int32_t)rs;
+        bool taken = (op == OP_BLTZ || op == OP_BLTZAL) ? value < 0
+                     : (op == OP_BGEZ || op == OP_BGEZAL) ? value >= 0
+                     : (op == OP_BLEZ) ? value <= 0
+                                       : value > 0;
+        SIM_PROFILE_HOOK(profile, branch(op, taken));
+        if (op == OP_BLTZAL || op == OP_BGEZAL)
+            registers[31] = PC;
+        if (taken)
+            PC = branchPC(PC, in.imm);
+        break;
+    }
+
+    //  j target | Jump กระโดดไปยัง target ,PC ใช้ Byte address , target เป็น word address เลยต้อง *4
+    case OP_J:
+        PC = (int)((uint32_t)in.imm << 2);
+        break;
+
+    //  jal target |Jump and Link กระโดดไปยัง target จากนั้น บันทึกค่าที่อยู่ถัดไป(PC + 4) ลง $ra (PC ถูก +4 ไปแล้วตอนต้น step)
+    case OP_JAL:
+        registers[31] = PC;
+        PC = (int)((uint32_t)in.imm << 2);
+        break;
+
+    //  jr register |Jump Register กระโดดไปยังที่อยู่ในรีจิสเตอร์ที่ระบุ
+    case OP_JR:
+        PC = (int)rs;
+        break;
+
+    //  jalr $rd, $rs | เหมือน jr แต่เก็บ PC + 4 ลง $rd (อ่าน $rs ไว้ก่อนแล้ว ใช้ $rd = $rs ได้)
+    case OP_JALR:
+        registers[in.rd] = PC;
+        PC = (int)rs;
+        break;
+
+    /*  And นำค่า 2 ค่าใน register มา and กันและเก็บผลลัพธ์ในรีจิสเตอร์ เป็นการตรวจสอบค่าบิตแต่ละบิตในสองตัวเลข ถ้าบิตทั้งสองเป็น 1 ผลลัพธ์จะเป็น 1 แต่ถ้าไม่ใช่ ผลลัพธ์จะเป็น 0
+        and $rd, $rs, $rt [$rd = $rs and $rt]
+    */
+    case OP_AND:
+        registers[in.rd] = (int)(rs & rt);
+        break;
+
+    /*  Or นำค่า 2 ค่าใน register มา or กันและเก็บผลลัพธ์ในรีจิสเตอร์ เป็นการตรวจสอบค่าบิตแต่ละบิตในสองตัวเลข ถ้าบิตอันใดอันหนึ่งเป็น 1 ผลลัพธ์จะเป็น 1 แต่ถ้าไม่ใช่ ผลลัพธ์จะเป็น 0
+        or $t0, $t1, $t2 [ $t0 = $t1 or $t2]
+    */
+    case OP_OR:
+        registers[in.rd] = (int)(rs | rt);
+        break;
+
+    // xor / nor [$rd = $rs ^ $rt] / [$rd = ~($rs | $rt)]
+    case OP_XOR:
+        registers[in.rd] = (int)(rs ^ rt);
+        break;
+    case OP_NOR:
+        registers[in.rd] = (int)~(rs | rt);
+        break;
+
+    /*  Set on Less Than กำหนดค่าเป็น 1 ถ้าค่าแรกน้อยกว่าค่า 2
+        slt $t0, $t1, $t2 [ $t0 = $t1 compare $t2] (sltu เทียบแบบ unsigned)
+    */
+    case OP_SLT:
+        registers[in.rd] = ((int32_t)rs < (int32_t)rt) ? 1 : 0;
+        break;
+    case OP_SLTU:
+        registers[in.rd] = (rs < rt) ? 1 : 0;
+        break;
+
+    /*  Shift เลื่อนบิต sll $rd, $rt, shamt [$rd = $rt << shamt]
+        srl เติม 0 ทางซ้าย, sra เติมบิตเครื่องหมาย, แบบ v ใช้ 5 bit ล่างของ $rs เป็นจำนวนบิต
+    */
+    case OP_SLL:
+        registers[in.rd] = (int)(rt << in.imm);
+        break;
+    case OP_SRL:
+        registers[in.rd] = (int)(rt >> in.imm);
+        break;
+    case OP_SRA:
+        registers[in.rd] = (int32_t)rt >> in.imm;
+        break;
+    case OP_SLLV:
+        registers[in.rd] = (int)(rt << (rs & 31));
+        break;
+    case OP_SRLV:
+        registers[in.rd] = (int)(rt >> (rs & 31));
+        break;
+    case OP_SRAV:
+        registers[in.rd] = (int32_t)rt >> (rs & 31);
+        break;
+
+    // move แบบมีเงื่อนไข movz $rd, $rs, $rt [if $rt == 0: $rd = $rs] / movn [if $rt != 0]
+    case OP_MOVZ:
+        if (rt == 0)
+            registers[in.rd] = (int)rs;
+        break;
+    case OP_MOVN:
+        if (rt != 0)
+            registers[in.rd] = (int)rs;
+        break;
+
+    // นับบิต 0 (clz) / บิต 1 (clo) ที่อยู่ติดกันจากบิตบนสุดของ $rs
+    case OP_CLZ:
+    case OP_CLO:
+    {
+        uint32_t bits = (op == OP_CLZ) ? rs : ~rs;
+        int count = 0;
+        while (count < 32 && (bits & 0x80000000u) == 0)
+        {
+            bits <<= 1;
+            count++;
+        }
+        registers[in.rd] = count;
+        break;
+    }
+
+    // trap if equal: teq $rs, $rt (compiler ใส่หลัง div เพื่อจับการหารด้วย 0)
+    case OP_TEQ:
+        if (rs == rt)
+            trap("Trap (teq)");
+        break;
+
+    // machine code ที่ยังไม่รองรับ (imm เก็บ word เดิมไว้)
+    case OP_INVALID:
+    {
+        ostringstream msg;
+        msg << "Unsupported instruction 0x" << hex << (uint32_t)in.imm;
+        trap(msg.str().c_str());
+    }
+    }
+    registers[0] = 0; // คำสั่งที่เขียน $zero ไม่มีผล (เขียนไปแล้วล้างกลับทีหลัง ถูกกว่าเช็คทุกคำสั่ง)
+}
+
+/*  วนทำงานโปรแกรมที่ load ไว้: fetch คำสั่งที่ code[(PC - code_base) / 4] แล้ว step
+    ไม่มีการ parse string / hash map / std::function ใน loop นี้เลย
+    หยุดเมื่อ PC ชี้ออกนอกโปรแกรม (halt) หรือทำครบ max_instructions คำสั่ง
+*/
+long long CPU::run(long long max_instructions)
+{
+    long long executed = 0;
+    while (!halted() && executed < max_instructions)
+    {
+        const Instr &in = code[((uint32_t)PC - code_base) / 4];
+        if (caches)
+            caches->fetch((uint32_t)PC);
+        SIM_PROFILE_HOOK(profile, instruction((uint32_t)PC, in.op));
+        step(in);
+        executed++;
+    }
+    return executed;
+}
+
+// เหมือน CPU::run แต่หลังทำแต่ละคำสั่งส่งให้ pipe คำนวณ cycle / stall
+long long CPU::runPipeline(Pipeline &pipe, long long max_instructions)
+{
+    long long executed = 0;
+    while (!halted() && executed < max_instructions)
+    {
+        uint32_t pc = (uint32_t)PC;
+        const Instr &in = code[(pc - code_base) / 4];
+        if (caches)
+            caches->fetch(pc);
+        SIM_PROFILE_HOOK(profile, instruction(pc, in.op));
+        step(in);
+        pipe.retire(in, pc, (uint32_t)PC);
+        executed++;
+    }
+    return executed;
+}
+
+// เหมือน CPU::run แต่ส่งทุกคำสั่งให้ trace (address ของ lw/sw ต้องคิดก่อนทำ เพราะ lw อาจเขียนทับ $rs)
+long long CPU::runTrace(TraceWriter &trace, long long max_instructions)
+{
+    long long executed = 0;
+    while (!halted() && executed < max_instructions)
+    {
+        uint32_t pc = (uint32_t)PC;
+        const Instr &in = code[(pc - code_base) / 4];
+        uint32_t mem_addr = (uint32_t)registers[in.rs] + (uint32_t)in.imm;
+        uint32_t store_value = (uint32_t)registers[in.rt];
+        if (caches)
+            caches->fetch(pc);
+        SIM_PROFILE_HOOK(profile, instruction(pc, in.op));
+        step(in);
+        trace.retire(pc, in, registers, mem_addr, store_value);
+        executed++;
+    }
+    return executed;
+}
+
+//-----------------------------------------------Basic-block cache (threaded code)-----------------------------------------------
+
+// คำสั่งที่อาจเปลี่ยน PC (ต้องเป็นคำสั่งสุดท้ายของ block)
+static constexpr bool changesPC(uint8_t op)
+{
+    return isBranch(op) || op == OP_J || op == OP_JAL || op == OP_JR || op == OP_JALR || op == OP_INVALID;
+}
+
+/*  คำสั่งที่ต้องรู้ PC ตอนทำงาน: branch/jump อ่านหรือเขียน PC, load/store/add/sub/addi/teq/OP_INVALID อาจ error แล้วต้องบอกได้ว่าเกิดที่ PC ไหน
+    คำสั่งอื่นใน block ไม่ต้องอัปเดต PC ทีละคำสั่ง ตั้งครั้งเดียวตอนจบ block
+*/
+static constexpr bool usesPC(uint8_t op)
+{
+    return changesPC(op) || isLoad(op) || isStore(op) || op == OP_ADD || op == OP_SUB || op == OP_ADDI || op == OP_TEQ;
+}
+
+// handler ของคำสั่งเดียว: OP เป็นค่าคงที่ตอน compile เลยไม่ต้อง switch ตอนรัน
+template <uint8_t OP>
+static void threadedOp(CPU &cpu, const ThreadedOp &op)
+{
+    if (cpu.caches)
+        cpu.caches->fetch(op.pc);
+    SIM_PROFILE_HOOK(cpu.profile, instruction(op.pc, OP));
+    if (usesPC(OP))
+        cpu.PC = (int)(op.pc + 4);
+    cpu.exec(OP, op.in);
+}
+
+// superinstruction: ทำ 2 คำสั่งที่มักจะมาคู่กันใน handler เดียว (dispatch ครั้งเดียว)
+template <uint8_t A, uint8_t B>
+static void threadedPair(CPU &cpu, const ThreadedOp &op)
+{
+    if (cpu.caches) // fetch ตามลำดับเดียวกับ CPU::run: fetch A, ทำ A, fetch B, ทำ B
+        cpu.caches->fetch(op.pc);
+    SIM_PROFILE_HOOK(cpu.profile, instruction(op.pc, A));
+    if (usesPC(A))
+        cpu.PC = (int)(op.pc + 4);
+    cpu.exec(A, op.in);
+    if (cpu.caches)
+        cpu.caches->fetch(op.pc + 4);
+    SIM_PROFILE_HOOK(cpu.profile, instruction(op.pc + 4, B));
+    if (usesPC(B))
+        cpu.PC = (int)(op.pc + 8);
+    cpu.exec(B, op.in2);
+}
+
+template <size_t... I>
+static constexpr array<Handler, OP_COUNT> makeHandlers(index_sequence<I...>)
+{
+    return {{&threadedOp<(uint8_t)I>...}};
+}
+
+static const array<Handler, OP_COUNT> op_handlers = makeHandlers(make_index_sequence<OP_COUNT>());
+
+/*  คู่คำสั่งที่รวมเป็น superinstruction ได้ (คู่ที่เจอบ่อยใน loop)
+    slt + bne/beq = if (a < b) , lw + add = โหลดแล้วบวกสะสม , add + bne = นับรอบ loop
+    คืน nullptr ถ้ารวมไม่ได้
+*/
+static Handler pairHandler(uint8_t a, uint8_t b)
+{
+    if (a == OP_SLT && b == OP_BNE)
+        return &threadedPair<OP_SLT, OP_BNE>;
+    if (a == OP_SLT && b == OP_BEQ)
+        return &threadedPair<OP_SLT, OP_BEQ>;
+    if (a == OP_LW && b == OP_ADD)
+        return &threadedPair<OP_LW, OP_ADD>;
+    if (a == OP_ADD && b == OP_BNE)
+        return &threadedPair<OP_ADD, OP_BNE>;
+    if (a == OP_ADDIU && b == OP_BNE) // แบบที่ compiler สร้าง (addiu/addu/sltu แทน li+add/slt)
+        return &threadedPair<OP_ADDIU, OP_BNE>;
+    if (a == OP_LW && b == OP_ADDU)
+        return &threadedPair<OP_LW, OP_ADDU>;
+    if (a == OP_SLTU && b == OP_BNE)
+        return &threadedPair<OP_SLTU, OP_BNE>;
+    return nullptr;
+}
+
+// คำสั่งที่อาจเปลี่ยน PC ต้องเป็นคำสั่งสุดท้ายของ block
+static bool endsBlock(uint8_t op)
+{
+    return changesPC(op);
+}
+
+int CPU::translate(uint32_t index)
+{
+    Block block;
+    block.start = index;
+    uint32_t i = index;
+    while (i < code_count && i - index < MAX_BLOCK) // จำกัดความยาว block กันโปรแกรมที่ไม่มี branch เลย
+    {
+        ThreadedOp op;
+        op.in = code[i];
+        op.pc = code_base + i * 4;
+        Handler pair = (i + 1 < code_count && !endsBlock(code[i].op)) ? pairHandler(code[i].op, code[i + 1].op) : nullptr;
+        if (pair != nullptr)
+        {
+            op.fn = pair;
+            op.in2 = code[i + 1];
+            op.length = 2;
+        }
+        else
+        {
+            op.fn = op_handlers[code[i].op];
+        }
+        block.ops.push_back(op);
+        i += op.length;
+        if (endsBlock(code[i - 1].op))
+            break;
+        if (code_watch != 0 && (isStore(code[i - 1].op) || (op.length == 2 && isStore(code[i - 2].op))))
+            break; // text อยู่ใน memory: store อาจเขียนทับคำสั่งถัดไป เลยจบ block หลัง store ทุกครั้ง
+    }
+    block.count = i - index;
+    block.end_pc = code_base + i * 4;
+    block.sets_pc = endsBlock(code[i - 1].op);
+
+    int id;
+    if (!free_blocks.empty()) // ใช้ช่องของ block ที่ถูกเขียนทับแล้ว (โปรแกรมที่แก้ตัวเองใน loop จะไม่ทำให้ blocks โตเรื่อยๆ)
+    {
+        id = free_blocks.back();
+        free_blocks.pop_back();
+        blocks[id] = move(block);
+    }
+    else
+    {
+        id = (int)blocks.size();
+        blocks.push_back(move(block));
+    }
+    block_of[index] = id;
+    return id;
+}
+
+// sw เขียนลงใน text ของโปรแกรม: ถอดรหัสใหม่ (ดู reloadCode) แล้วจดไว้ให้ MultiCore ส่งต่อให้ core อื่น
+void CPU::writeCode(uint32_t addr)
+{
+    reloadCode(addr);
+    if (record_code_writes)
+        code_writes.push_back(addr);
+}
+
+/*  word ที่ addr ใน text เปลี่ยน: copy code มาเป็นของ CPU นี้เอง (ครั้งแรกครั้งเดียว) แล้วถอดรหัส word ใหม่จาก memory
+    block ไหนที่ครอบคำสั่งนี้อยู่จะถูกลบออกจาก cache (sw เป็นคำสั่งสุดท้ายของ block เสมอ เลยไม่มี block ไหนรันค้างอยู่)
+    หา block จาก block_of ของ MAX_BLOCK คำสั่งก่อนหน้าแทนการไล่ทุก block ช่องที่ลบจะถูกใช้ซ้ำตอน translate
+    (ops ของ block ที่กำลังรันอยู่ยังไม่ถูกเขียนทับจนกว่าจะ translate ครั้งถัดไป)
+*/
+void CPU::reloadCode(uint32_t addr)
+{
+    uint32_t index = (addr - code_base) / 4;
+    uint32_t word = memory.read32(code_base + index * 4);
+    if (private_code.empty())
+    {
+        private_code.assign(code, code + code_count);
+        code = private_code.data();
+    }
+    private_code[index] = decodeWord(word, code_base + index * 4);
+
+    uint32_t first = index >= MAX_BLOCK ? index - MAX_BLOCK : 0; // block ยาวได้ถึง MAX_BLOCK + 1 ถ้าจบด้วย superinstruction
+    for (uint32_t start = first; start <= index; start++)
+    {
+        int id = block_of[start];
+        if (id >= 0 && index < start + blocks[id].count)
+        {
+            blocks[id].valid = false;
+            block_of[start] = -1;
+            free_blocks.push_back(id);
+        }
+    }
+}
+
+/*  เหมือน run แต่แปลโปรแกรมเป็น basic block ครั้งเดียวแล้วเรียก handler ต่อกันไปทั้ง block
+    เช็ค halt / จำนวนคำสั่งแค่ครั้งเดียวต่อ block ถ้าเหลือจำนวนคำสั่งไม่พอทั้ง block จะทำทีละคำสั่งแทน (นับได้ตรง)
+*/
+long long CPU::runBlocks(long long max_instructions)
+{
+    long long executed = 0;
+    while (!halted() && executed < max_instructions)
+    {
+        uint32_t index = ((uint32_t)PC - code_base) / 4;
+        int id = block_of[index];
+        if (id < 0)
+            id = translate(index);
+
+        if (blocks[id].count > max_instructions - executed)
+        {
+            if (caches)
+                caches->fetch((uint32_t)PC);
+            SIM_PROFILE_HOOK(profile, instruction((uint32_t)PC, code[index].op));
+            step(code[index]);
+            executed++;
+            continue;
+        }
+
+        // sw จะเป็นคำสั่งสุดท้ายของ block เสมอถ้า text อยู่ใน memory เลยไม่ต้องเช็คการเขียนทับระหว่าง block
+        const Block &block = blocks[id];
+        for (const ThreadedOp &op : block.ops)
+            op.fn(*this, op);
+        if (!block.sets_pc)
+            PC = (int)block.end_pc;
+        executed += block.count;
+    }
+    return executed;
+}
+
+// function exucute รับคำสั่ง 1 บรรทัด ถอดรหัสแล้วทำงานทันที (ใช้ตอนพิมพ์คำสั่งทีละบรรทัด)
+void CPU::execute(string instruction)
+{
+    step(decode(instruction));
+}
+
+void CPU::printRegisters() // print ค่าในทุก register
+{
+    cout << "Register values:\n";
+
+    vector<pair<string, int>> sorted_registers;//สร้างตัวแปร Vector ที่เป็นชนิดคู่(pair) ซึ่งเอา string มาคู่กับ int
+    for (const auto &r : reg_map) {//เอาค่าใน reg_map ใส่ลง vector
+        sorted_registers.push_back({r.first, r.second});
+    }
+
+    // sortค่าตาม registermap int จากน้อยไปมาก
+    sort(sorted_registers.begin(), sorted_registers.end(),
+         [](const pair<string, int> &a, const pair<string, int> &b) {//รับ parameter pair<string, int> มาใส่เป็น address ของ a และ b
+             return a.second < b.second; //ทำให้เรียงลำดับจากน้อยไปมาก
+         });
+
+    // แสดงผลตามลำดับที่ถูกต้อง
+    for (const auto &r : reg_map)
+    {
+        cout << r.first << " = " << registers[r.second] << "\n";
+    }
+    /*for loop
+    r.first คือ ค่าของ reg_map key(string)
+    r.second คือ ค่า ของ reg_map value(int)
+    registers[r.second] คือ เอาค่าเลขของ r.second มาค้นใน array ตำแหน่ง registers
+    */
+}
+
+//-----------------------------------------------Trace codec / reader-----------------------------------------------
+
+/*  บีบอัดแบบ LZ (รูปแบบเดียวกับ LZ4 block): token 1 byte = ความยาว literal (4 bit บน) + ความยาว match - 4 (4 bit ล่าง)
+    ถ้าค่าเป็น 15 จะมี byte ต่อท้ายบวกเพิ่มไปเรื่อยๆ จนเจอ byte ที่ไม่ใช่ 255, หลัง literal เป็น offset 2 byte ของ match
+    sequence สุดท้ายมีแต่ literal
+*/
+static void lzWriteLength(vector<uint8_t> &out, size_t length)
+{
+    for (; length >= 255; length -= 255)
+        out.push_back(255);
+    out.push_back((uint8_t)length);
+}
+
+void lzCompress(const uint8_t *src, size_t size, vector<uint8_t> &out)
+{
+    const size_t MIN_MATCH = 4, MAX_OFFSET = 65535, HASH_BITS = 14;
+    vector<uint32_t> table(1u << HASH_BITS, 0xFFFFFFFFu);
+    auto hash = [&](size_t pos) {
+        uint32_t v;
+        memcpy(&v, src + pos, 4);
+        return (v * 2654435761u) >> (32 - HASH_BITS);
+    };
+
+    out.clear();
+    size_t anchor = 0, pos = 0;
+    while (size >= MIN_MATCH && pos + MIN_MATCH <= size)
+    {
+        uint32_t h = hash(pos);
+        size_t candidate = table[h];
+        table[h] = (uint32_t)pos;
+        if (candidate == 0xFFFFFFFFu || pos - candidate > MAX_OFFSET || memcmp(src + candidate, src + pos, MIN_MATCH) != 0)
+        {
+            pos++;
+            continue;
+        }
+        size_t length = MIN_MATCH;
+        while (pos + length + 8 <= size) // เทียบทีละ 8 byte ก่อน
+        {
+            uint64_t a, b;
+            memcpy(&a, src + candidate + length, 8);
+            memcpy(&b, src + pos + length, 8);
+            if (a != b)
+                break;
+            length += 8;
+        }
+        while (pos + length < size && src[candidate + length] == src[pos + length])
+            length++;
+
+        size_t literals = pos - anchor;
+        out.push_back((uint8_t)((min<size_t>(literals, 15) << 4) | min<size_t>(length - MIN_MATCH, 15)));
+        if (literals >= 15)
+            lzWriteLength(out, literals - 15);
+        out.insert(out.end(), src + anchor, src + pos);
+        size_t offset = pos - candidate;
+        out.push_back((uint8_t)offset);
+        out.push_back((uint8_t)(offset >> 8));
+        if (length - MIN_MATCH >= 15)
+            lzWriteLength(out, length - MIN_MATCH - 15);
+        pos += length;
+        anchor = pos;
+    }
+    size_t literals = size - anchor;
+    out.push_back((uint8_t)(min<size_t>(literals, 15) << 4));
+    if (literals >= 15)
+        lzWriteLength(out, literals - 15);
+    out.insert(out.end(), src + anchor, src + size);
+}
+
+// คืนข้อมูลที่บีบอัดด้วย lzCompress ลงใน dst ขนาด size พอดี (ข้อมูลเสีย = throw)
+void lzDecompress(const uint8_t *src, size_t src_size, uint8_t *dst, size_t size)
+{
+    size_t in = 0, pos = 0;
+    auto readLength = [&](size_t length) {
+        if (length != 15)
+            return length;
+        uint8_t b;
+        do
+        {
+            if (in >= src_size)
+                throw runtime_error("Corrupt trace chunk");
+            b = src[in++];
+            length += b;
+        } while (b == 255);
+        return length;
+    };
+    while (in < src_size)
+    {
+        uint8_t token = src[in++];
+        size_t literals = readLength(token >> 4);
+        if (literals > src_size - in || literals > size - pos)
+            throw runtime_error("Corrupt trace chunk");
+        memcpy(dst + pos, src + in, literals);
+        in += literals;
+        pos += literals;
+        if (in == src_size)
+            break;
+        if (src_size - in < 2)
+            throw runtime_error("Corrupt trace chunk");
+        size_t offset = src[in] | (size_t)src[in + 1] << 8;
+        in += 2;
+        size_t length = readLength(token & 15) + 4;
+        if (offset == 0 || offset > pos || length > size - pos)
+            throw runtime_error("Corrupt trace chunk");
+        for (size_t i = 0; i < length; i++, pos++) // match ซ้อนกับตัวเองได้ ต้อง copy ทีละ byte
+            dst[pos] = dst[pos - offset];
+    }
+    if (pos != size)
+        throw runtime_error("Corrupt trace chunk");
+}
+
+const char *const REGISTER_NAMES[32] = {
+    "$zero", "$at", "$v0", "$v1", "$a0", "$a1", "$a2", "$a3",
+    "$t0", "$t1", "$t2", "$t3", "$t4", "$t5", "$t6", "$t7",
+    "$s0", "$s1", "$s2", "$s3", "$s4", "$s5", "$s6", "$s7",
+    "$t8", "$t9", "$k0", "$k1", "$gp", "$sp", "$fp", "$ra"};
+
+// แปลงคำสั่งที่ถอดรหัสแล้วกลับเป็นข้อความแบบ assembly (branch แสดง offset, jump แสดง word address)
+string formatInstr(const Instr &in)
+{
+    ostringstream text;
+    text << opcodeName(in.op);
+    const char *rd = REGISTER_NAMES[in.rd & 31], *rs = REGISTER_NAMES[in.rs & 31], *rt = REGISTER_NAMES[in.rt & 31];
+    switch (in.op)
+    {
+    case OP_ADD:
+    case OP_SUB:
+    case OP_MUL:
+    case OP_AND:
+    case OP_OR:
+    case OP_SLT:
+    case OP_ADDU:
+    case OP_SUBU:
+    case OP_XOR:
+    case OP_NOR:
+    case OP_SLTU:
+    case OP_MOVZ:
+    case OP_MOVN:
+        text << " " << rd << ", " << rs << ", " << rt;
+        break;
+    case OP_SLLV:
+    case OP_SRLV:
+    case OP_SRAV:
+        text << " " << rd << ", " << rt << ", " << rs;
+        break;
+    case OP_SLL:
+    case OP_SRL:
+    case OP_SRA:
+        text << " " << rd << ", " << rt << ", " << in.imm;
+        break;
+    case OP_MULT:
+    case OP_MULTU:
+    case OP_DIV:
+    case OP_DIVU:
+    case OP_MADD:
+    case OP_MADDU:
+    case OP_MSUB:
+    case OP_MSUBU:
+    case OP_TEQ:
+        text << " " << rs << ", " << rt;
+        break;
+    case OP_MFHI:
+    case OP_MFLO:
+        text << " " << rd;
+        break;
+    case OP_CLZ:
+    case OP_CLO:
+    case OP_JALR:
+        text << " " << rd << ", " << rs;
+        break;
+    case OP_ADDI:
+    case OP_ADDIU:
+    case OP_SLTI:
+    case OP_SLTIU:
+    case OP_ANDI:
+    case OP_ORI:
+    case OP_XORI:
+        text << " " << rt << ", " << rs << ", " << in.imm;
+        break;
+    case OP_LW:
+    case OP_SW:
+    case OP_LL:
+    case OP_SC:
+    case OP_LB:
+    case OP_LBU:
+    case OP_LH:
+    case OP_LHU:
+    case OP_SB:
+    case OP_SH:
+        text << " " << rt << ", " << in.imm << "(" << rs << ")";
+        break;
+    case OP_LI:
+        text << " " << rt << ", " << in.imm;
+        break;
+    case OP_BEQ:
+    case OP_BNE:
+        text << " " << rs << ", " << rt << ", " << in.imm;
+        break;
+    case OP_BLTZ:
+    case OP_BGEZ:
+    case OP_BLEZ:
+    case OP_BGTZ:
+    case OP_BLTZAL:
+    case OP_BGEZAL:
+        text << " " << rs << ", " << in.imm;
+        break;
+    case OP_J:
+    case OP_JAL:
+        text << " " << in.imm;
+        break;
+    case OP_JR:
+    case OP_MTHI:
+    case OP_MTLO:
+        text << " " << rs;
+        break;
+    default:
+        break;
+    }
+    return text.str();
+}
+
+/*  ตัวอ่าน trace (--read-trace): แปลงไฟล์ trace เป็นข้อความ 1 บรรทัดต่อคำสั่ง
+    PC  คำสั่ง  [register ที่เขียน]  [load/store address = ค่า]
+*/
+void readTrace(const string &path, ostream &out)
+{
+    ifstream in(path, ios::binary);
+    if (!in)
+        throw runtime_error("Cannot open trace: " + path);
+    char magic[sizeof(TRACE_MAGIC)];
+    uint32_t header[2];
+    if (!in.read(magic, sizeof(magic)) || !in.read((char *)header, sizeof(header)) || memcmp(magic, TRACE_MAGIC, sizeof(magic)) != 0)
+        throw runtime_error("Not a trace file: " + path);
+    if (header[0] != TRACE_VERSION || header[1] != sizeof(TraceRecord))
+        throw runtime_error("Unsupported trace version " + to_string(header[0]));
+
+    vector<uint8_t> packed;
+    vector<TraceRecord> records;
+    uint32_t chunk[3];
+    char line[64];
+    while (in.read((char *)chunk, sizeof(chunk)))
+    {
+        size_t raw_size = (size_t)chunk[0] * sizeof(TraceRecord);
+        if (chunk[1] > 1 || (chunk[1] == 0 && chunk[2] != raw_size))
+            throw runtime_error("Corrupt trace chunk");
+        records.resize(chunk[0]);
+        packed.resize(chunk[2]);
+        if (!in.read((char *)packed.data(), chunk[2]))
+            throw runtime_error("Truncated trace file");
+        if (chunk[1] == 1)
+            lzDecompress(packed.data(), packed.size(), (uint8_t *)records.data(), raw_size);
+        else
+            memcpy(records.data(), packed.data(), raw_size);
+
+        uint32_t next_pc = 0, last_addr = 0;
+        for (const TraceRecord &r : records)
+        {
+            uint32_t pc = next_pc + (uint32_t)r.pc_delta;
+            next_pc = pc + 4;
+            Instr instr = {r.op, r.rd, r.rs, r.rt, r.imm};
+            string text = formatInstr(instr);
+            snprintf(line, sizeof(line), "0x%08x  ", pc);
+            out << line << text;
+            if (r.flags != 0 && text.size() < 28)
+                out << string(28 - text.size(), ' ');
+            if (r.flags & TRACE_REG)
+                out << "  " << REGISTER_NAMES[r.reg & 31] << " = " << r.reg_value;
+            if (r.flags & (TRACE_LOAD | TRACE_STORE))
+            {
+                last_addr += (uint32_t)r.mem_delta;
+                snprintf(line, sizeof(line), "  %s [0x%08x] = %d", r.flags & TRACE_STORE ? "store" : "load", last_addr, (int)r.mem_value);
+                out << line;
+            }
+            out << "\n";
+        }
+    }
+}
+
+//-----------------------------------------------Lockstep (SIMD) engine-----------------------------------------------
+
+/*  ตัวดำเนินการกับ int32 หลาย lane พร้อมกัน เลือกตามชุดคำสั่งที่ compile ได้ (cmake -DSIM_NATIVE=ON หรือ -mavx2 / -mavx512f)
+    mask เป็น vector ที่แต่ละช่องเป็น -1 (ใช่) หรือ 0 (ไม่ใช่) เหมือนผลของ compare
+*/
+#if defined(__AVX512F__) && defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized" // เตือนผิดจาก _mm512_undefined ใน header ของ GCC 12 (ส่วนนี้อยู่ท้ายไฟล์)
+#endif
+namespace simd
+{
+#if defined(__AVX512F__)
+constexpr uint32_t WIDTH = 16;
+typedef __m512i V;
+static SIM_INLINE V loadv(const int32_t *p) { return _mm512_loadu_si512((const void *)p); }
+static SIM_INLINE void storev(int32_t *p, V v) { _mm512_storeu_si512((void *)p, v); }
+static SIM_INLINE V set1(int32_t x) { return _mm512_set1_epi32(x); }
+static SIM_INLINE V add(V a, V b) { return _mm512_add_epi32(a, b); }
+static SIM_INLINE V sub(V a, V b) { return _mm512_sub_epi32(a, b); }
+static SIM_INLINE V mul(V a, V b) { return _mm512_mullo_epi32(a, b); }
+static SIM_INLINE V andv(V a, V b) { return _mm512_and_si512(a, b); }
+static SIM_INLINE V orv(V a, V b) { return _mm512_or_si512(a, b); }
+static SIM_INLINE V xorv(V a, V b) { return _mm512_xor_si512(a, b); }
+static SIM_INLINE V andnot(V a, V b) { return _mm512_andnot_si512(a, b); } // ~a & b
+static SIM_INLINE V sll(V a, int n) { return _mm512_sll_epi32(a, _mm_cvtsi32_si128(n)); }
+static SIM_INLINE V srl(V a, int n) { return _mm512_srl_epi32(a, _mm_cvtsi32_si128(n)); }
+static SIM_INLINE V sra(V a, int n) { return _mm512_sra_epi32(a, _mm_cvtsi32_si128(n)); }
+static SIM_INLINE V sllv(V a, V n) { return _mm512_sllv_epi32(a, andv(n, set1(31))); }
+static SIM_INLINE V srlv(V a, V n) { return _mm512_srlv_epi32(a, andv(n, set1(31))); }
+static SIM_INLINE V srav(V a, V n) { return _mm512_srav_epi32(a, andv(n, set1(31))); }
+static SIM_INLINE V fromMask(__mmask16 k) { return _mm512_maskz_set1_epi32(k, -1); }
+static SIM_INLINE V eq(V a, V b) { return fromMask(_mm512_cmpeq_epi32_mask(a, b)); }
+static SIM_INLINE V lt(V a, V b) { return fromMask(_mm512_cmplt_epi32_mask(a, b)); }
+static SIM_INLINE V ltu(V a, V b) { return fromMask(_mm512_cmplt_epu32_mask(a, b)); }
+static SIM_INLINE V blend(V old, V now, V m) { return _mm512_mask_blend_epi32(_mm512_test_epi32_mask(m, m), old, now); }
+static SIM_INLINE uint32_t bits(V m) { return _mm512_test_epi32_mask(m, m); } // bit i = ช่อง i
+#elif defined(__AVX2__)
+constexpr uint32_t WIDTH = 8;
+typedef __m256i V;
+static SIM_INLINE V loadv(const int32_t *p) { return _mm256_loadu_si256((const __m256i *)p); }
+static SIM_INLINE void storev(int32_t *p, V v) { _mm256_storeu_si256((__m256i *)p, v); }
+static SIM_INLINE V set1(int32_t x) { return _mm256_set1_epi32(x); }
+static SIM_INLINE V add(V a, V b) { return _mm256_add_epi32(a, b); }
+static SIM_INLINE V sub(V a, V b) { return _mm256_sub_epi32(a, b); }
+static SIM_INLINE V mul(V a, V b) { return _mm256_mullo_epi32(a, b); }
+static SIM_INLINE V andv(V a, V b) { return _mm256_and_si256(a, b); }
+static SIM_INLINE V orv(V a, V b) { return _mm256_or_si256(a, b); }
+static SIM_INLINE V xorv(V a, V b) { return _mm256_xor_si256(a, b); }
+static SIM_INLINE V andnot(V a, V b) { return _mm256_andnot_si256(a, b); }
+static SIM_INLINE V sll(V a, int n) { return _mm256_sll_epi32(a, _mm_cvtsi32_si128(n)); }
+static SIM_INLINE V srl(V a, int n) { return _mm256_srl_epi32(a, _mm_cvtsi32_si128(n)); }
+static SIM_INLINE V sra(V a, int n) { return _mm256_sra_epi32(a, _mm_cvtsi32_si128(n)); }
+static SIM_INLINE V sllv(V a, V n) { return _mm256_sllv_epi32(a, andv(n, set1(31))); }
+static SIM_INLINE V srlv(V a, V n) { return _mm256_srlv_epi32(a, andv(n, set1(31))); }
+static SIM_INLINE V srav(V a, V n) { return _mm256_srav_epi32(a, andv(n, set1(31))); }
+static SIM_INLINE V eq(V a, V b) { return _mm256_cmpeq_epi32(a, b); }
+static SIM_INLINE V lt(V a, V b) { return _mm256_cmpgt_epi32(b, a); }
+static SIM_INLINE V ltu(V a, V b) { return lt(xorv(a, set1(INT32_MIN)), xorv(b, set1(INT32_MIN))); } // กลับบิตเครื่องหมายแล้วเทียบแบบ signed
+static SIM_INLINE V blend(V old, V now, V m) { return _mm256_blendv_epi8(old, now, m); }
+static SIM_INLINE uint32_t bits(V m) { return (uint32_t)_mm256_movemask_ps(_mm256_castsi256_ps(m)); }
+#else
+constexpr uint32_t WIDTH = 1; // ไม่มี SIMD: ทีละ lane (compiler อาจ vectorize ให้เอง)
+typedef int32_t V;
+static SIM_INLINE V loadv(const int32_t *p) { return *p; }
+static SIM_INLINE void storev(int32_t *p, V v) { *p = v; }
+static SIM_INLINE V set1(int32_t x) { return x; }
+static SIM_INLINE V add(V a, V b) { return (int32_t)((uint32_t)a + (uint32_t)b); }
+static SIM_INLINE V sub(V a, V b) { return (int32_t)((uint32_t)a - (uint32_t)b); }
+static SIM_INLINE V mul(V a, V b) { return (int32_t)((uint32_t)a * (uint32_t)b); }
+static SIM_INLINE V andv(V a, V b) { return a & b; }
+static SIM_INLINE V orv(V a, V b) { return a | b; }
+static SIM_INLINE V xorv(V a, V b) { return a ^ b; }
+static SIM_INLINE V andnot(V a, V b) { return ~a & b; }
+static SIM_INLINE V sll(V a, int n) { return (int32_t)((uint32_t)a << n); }
+static SIM_INLINE V srl(V a, int n) { return (int32_t)((uint32_t)a >> n); }
+static SIM_INLINE V sra(V a, int n) { return a >> n; }
+static SIM_INLINE V sllv(V a, V n) { return sll(a, n & 31); }
+static SIM_INLINE V srlv(V a, V n) { return srl(a, n & 31); }
+static SIM_INLINE V srav(V a, V n) { return sra(a, n & 31); }
+static SIM_INLINE V eq(V a, V b) { return a == b ? -1 : 0; }
+static SIM_INLINE V lt(V a, V b) { return a < b ? -1 : 0; }
+static SIM_INLINE V ltu(V a, V b) { return (uint32_t)a < (uint32_t)b ? -1 : 0; }
+static SIM_INLINE V blend(V old, V now, V m) { return m ? now : old; }
+static SIM_INLINE uint32_t bits(V m) { return m != 0; }
+#endif
+static SIM_INLINE V zero() { return set1(0); }
+} // namespace simd
+
+static uint32_t popcount(uint32_t x)
+{
+    uint32_t n = 0;
+    for (; x; x &= x - 1)
+        n++;
+    return n;
+}
+
+// ข้อความ error ของคำสั่งที่ pc แบบเดียวกับ CPU::trap
+static string atPC(const string &what, uint32_t pc)
+{
+    ostringstream msg;
+    msg << what << " at PC 0x" << hex << pc;
+    return msg.str();
+}
+
+const char *LockstepCPU::simdName()
+{
+#if defined(__AVX512F__)
+    return "avx512";
+#elif defined(__AVX2__)
+    return "avx2";
+#else
+    return "scalar";
+#endif
+}
+
+LockstepCPU::LockstepCPU(uint32_t lane_count)
+    : lanes(lane_count), stride((lane_count + simd::WIDTH - 1) / simd::WIDTH * simd::WIDTH)
+{
+    if (lane_count == 0)
+        throw runtime_error("Lane count must be at least 1");
+    regs.assign((size_t)32 * stride, 0);
+    hi.assign(stride, 0);
+    lo.assign(stride, 0);
+    pc.assign(lanes, 0);
+    executed.assign(lanes, 0);
+    fault.assign(lanes, string());
+    link_addr.assign(lanes, 0);
+    link_value.assign(lanes, 0);
+    link_valid.assign(lanes, 0);
+    scratch.assign(stride, 0);
+}
+
+void LockstepCPU::load(const Program &prog)
+{
+    code = prog.code.data();
+    code_base = prog.text_base;
+    code_count = (uint32_t)prog.code.size();
+    code_limit = prog.code_in_memory ? code_count * 4 : 0;
+    postDominators();
+
+    fill(regs.begin(), regs.end(), 0);
+    fill(hi.begin(), hi.end(), 0);
+    fill(lo.begin(), lo.end(), 0);
+    memory.clear(); // memory ใหม่ทุก lane (Memory() แต่ละตัวมี page ของตัวเอง)
+    memory.resize(lanes);
+    for (uint32_t lane = 0; lane < lanes; lane++)
+    {
+        reg(lane, 28) = 0x10008000; // $gp
+        reg(lane, 29) = 0x7FFFEFFC; // $sp
+        pc[lane] = prog.entry;
+        executed[lane] = 0;
+        fault[lane].clear();
+        link_valid[lane] = 0;
+        for (const Segment &seg : prog.data)
+            memory[lane].writeBytes(seg.addr, seg.bytes.data(), seg.bytes.size());
+    }
+}
+
+/*  หา immediate post-dominator ของทุกคำสั่ง (Cooper, Harvey & Kennedy บน control-flow graph กลับด้าน เริ่มจาก exit)
+    jal/jalr/bltzal/bgezal ถือว่ากลับมาที่คำสั่งถัดไป, jr และคำสั่งที่ไม่รองรับถือว่าไป exit (จบ function)
+    branch ที่ post-dominator เป็น exit หรือวนไม่จบ จะไม่มีจุดรวมในตัวเอง ใช้จุดรวมของกลุ่มที่อยู่ข้างนอกแทน
+*/
+void LockstepCPU::postDominators()
+{
+    const uint32_t exit = code_count, none = UINT32_MAX;
+    auto indexOf = [&](uint32_t target_pc) { return (target_pc - code_base) / 4 < code_count ? (target_pc - code_base) / 4 : exit; };
+    vector<array<uint32_t, 2>> succ(code_count, {{none, none}});
+    vector<vector<uint32_t>> pred(code_count + 1);
+    for (uint32_t i = 0; i < code_count; i++)
+    {
+        const Instr &in = code[i];
+        uint32_t next = i + 1;
+        if (isBranch(in.op))
+            succ[i] = {{next, indexOf(code_base + (i + 1) * 4 + ((uint32_t)in.imm << 2))}};
+        else if (in.op == OP_J)
+            succ[i][0] = indexOf((uint32_t)in.imm << 2);
+        else if (in.op == OP_JR || in.op == OP_INVALID)
+            succ[i][0] = exit;
+        else
+            succ[i][0] = next;
+        for (uint32_t s : succ[i])
+            if (s != none)
+                pred[s].push_back(i);
+    }
+
+    // postorder ของกราฟกลับด้าน (เดินจาก exit ไปตาม pred)
+    vector<uint32_t> order, number(code_count + 1, none);
+    vector<pair<uint32_t, size_t>> dfs = {{exit, 0}};
+    vector<uint8_t> seen(code_count + 1, 0);
+    seen[exit] = 1;
+    while (!dfs.empty())
+    {
+        uint32_t node = dfs.back().first;
+        size_t &next = dfs.back().second;
+        if (next < pred[node].size())
+        {
+            uint32_t p = pred[node][next++];
+            if (!seen[p])
+            {
+                seen[p] = 1;
+                dfs.push_back({p, 0});
+            }
+            continue;
+        }
+        number[node] = (uint32_t)order.size();
+        order.push_back(node);
+        dfs.pop_back();
+    }
+
+    vector<uint32_t> ipdom(code_count + 1, none);
+    ipdom[exit] = exit;
+    auto intersect = [&](uint32_t a, uint32_t b) {
+        while (a != b)
+        {
+            while (number[a] < number[b])
+                a = ipdom[a];
+            while (number[b] < number[a])
+                b = ipdom[b];
+        }
+        return a;
+    };
+    for (bool changed = true; changed;)
+    {
+        changed = false;
+        for (size_t k = order.size() - 1; k-- > 0;) // reverse postorder ไม่รวม exit (ตัวสุดท้าย)
+        {
+            uint32_t node = order[k], best = none;
+            for (uint32_t s : succ[node])
+            {
+                if (s == none || ipdom[s] == none)
+                    continue;
+                best = best == none ? s : intersect(s, best);
+            }
+            if (best != ipdom[node])
+            {
+                ipdom[node] = best;
+                changed = true;
+            }
+        }
+    }
+
+    reconverge_at.assign(code_count, NO_PC);
+    for (uint32_t i = 0; i < code_count; i++)
+    {
+        if (ipdom[i] != none && ipdom[i] != exit)
+            reconverge_at[i] = code_base + ipdom[i] * 4;
+    }
+}
+
+// บวกจำนวนคำสั่งที่กลุ่มทำไปให้ทุก lane ในกลุ่ม
+void LockstepCPU::flush(Group &group)
+{
+    if (group.steps == 0)
+        return;
+    for (uint32_t lane = 0; lane < lanes; lane++)
+    {
+        if (group.mask[lane])
+            executed[lane] += group.steps;
+    }
+    group.budget -= group.steps;
+    group.steps = 0;
+}
+
+// lane จบ (halt / ครบจำนวนคำสั่ง / error) เอาออกจากทุกกลุ่ม ต้อง flush กลุ่มบนสุดก่อน
+void LockstepCPU::remove(uint32_t lane, uint32_t at_pc, const string &error)
+{
+    pc[lane] = at_pc;
+    fault[lane] = error;
+    for (Group &group : stack)
+    {
+        if (group.mask[lane])
+        {
+            group.mask[lane] = 0;
+            group.active--;
+        }
+    }
+}
+
+// แยก lane ใน mask ตาม PC ปลายทาง (target[lane]) เป็นกลุ่มละ PC แล้วดันลง stack ทุกกลุ่มรวมกลับที่ reconverge (executed ต้อง flush แล้ว)
+void LockstepCPU::split(const vector<int32_t> &target, const vector<int32_t> &mask, uint32_t reconverge)
+{
+    vector<Group> groups;
+    for (uint32_t lane = 0; lane < lanes; lane++)
+    {
+        if (!mask[lane])
+            continue;
+        uint32_t to = (uint32_t)target[lane];
+        size_t g = 0;
+        while (g < groups.size() && groups[g].pc != to)
+            g++;
+        if (g == groups.size())
+        {
+            groups.emplace_back();
+            groups[g].pc = to;
+            groups[g].reconverge = reconverge;
+            groups[g].mask.assign(stride, 0);
+            groups[g].budget = LLONG_MAX;
+        }
+        groups[g].mask[lane] = -1;
+        groups[g].active++;
+        groups[g].budget = min(groups[g].budget, limit[lane] - executed[lane]);
+    }
+    for (size_t g = groups.size(); g-- > 0;) // กลุ่มแรกอยู่บนสุด
+        stack.push_back(move(groups[g]));
+}
+
+long long LockstepCPU::run(long long max_instructions)
+{
+    return run(vector<long long>(lanes, max_instructions));
+}
+
+/*  วนทำคำสั่งของกลุ่มบนสุดของ stack จนทุก lane จบ
+    เริ่มจากแยก lane ตาม PC ปัจจุบัน (หลัง load ทุก lane อยู่ที่ entry เดียวกัน) lane ที่ error / halt / ครบแล้วไม่ถูกรันอีก
+    จำนวนคำสั่งนับทีละกลุ่ม (Group::steps) แล้วค่อยบวกเข้า lane ตอนกลุ่มเปลี่ยน จะได้ไม่ต้องนับทุก lane ทุกคำสั่ง
+*/
+long long LockstepCPU::run(const vector<long long> &max_instructions)
+{
+    if (max_instructions.size() != lanes)
+        throw runtime_error("Need one instruction limit per lane");
+    limit = max_instructions;
+    long long before = 0;
+    vector<int32_t> target(stride, 0), mask(stride, 0);
+    for (uint32_t lane = 0; lane < lanes; lane++)
+    {
+        before += executed[lane];
+        if (fault[lane].empty() && !halted(lane) && executed[lane] < limit[lane])
+        {
+            mask[lane] = -1;
+            target[lane] = (int32_t)pc[lane];
+        }
+    }
+    stack.clear();
+    split(target, mask, NO_PC);
+
+    while (!stack.empty())
+    {
+        Group &group = stack.back();
+        if (group.active == 0 || (group.pc == group.reconverge && group.reconverge != NO_PC))
+        {
+            Group done = move(group);
+            stack.pop_back();
+            if (done.inherit && !stack.empty()) // กลับจาก call: lane ชุดเดียวกัน นับต่อในกลุ่มที่เรียก
+            {
+                stack.back().steps = done.steps;
+                stack.back().budget = done.budget;
+            }
+            else
+            {
+                flush(done);
+                if (!stack.empty())
+                    stack.back().budget = 0; // lane กลับมาจากหลายกลุ่ม คิด budget ใหม่
+            }
+            continue;
+        }
+        uint32_t index = (group.pc - code_base) / 4;
+        if (index >= code_count) // PC ออกนอกโปรแกรม: ทุก lane ในกลุ่มจบ
+        {
+            flush(group);
+            for (uint32_t lane = 0; lane < lanes; lane++)
+                if (group.mask[lane])
+                    remove(lane, group.pc, string());
+            continue;
+        }
+        if (group.steps >= group.budget) // มี lane ครบ limit หรือต้องคิด budget ใหม่
+        {
+            flush(group);
+            long long budget = LLONG_MAX;
+            for (uint32_t lane = 0; lane < lanes; lane++)
+            {
+                if (!group.mask[lane])
+                    continue;
+                if (executed[lane] >= limit[lane])
+                    remove(lane, group.pc, string());
+                else
+                    budget = min(budget, limit[lane] - executed[lane]);
+            }
+            group.budget = budget;
+            continue;
+        }
+        group.steps++;
+        issued++;
+        step(group, code[index]); // อาจดัน / เอากลุ่มออกจาก stack (group ใช้ต่อไม่ได้)
+    }
+
+    long long after = 0;
+    for (long long n : executed)
+        after += n;
+    return after - before;
+}
+
+// ทำคำสั่ง in กับทุก lane ที่ active ในกลุ่ม (PC ของกลุ่มชี้ที่คำสั่งนี้)
+void LockstepCPU::step(Group &group, const Instr &in)
+{
+    using namespace simd;
+    uint32_t at = group.pc;
+    group.pc += 4;
+    const int32_t *m = group.mask.data();
+    const bool full = group.active == lanes;
+    auto row = [&](uint8_t r) { return regs.data() + (size_t)r * stride; };
+    const int32_t *rs = row(in.rs), *rt = row(in.rt);
+    const V imm = set1(in.imm);
+
+    // dst[lane] = f(l) ทุก lane ที่ active (dst = $zero ไม่ต้องทำอะไร)
+    auto write = [&](int32_t *dst, auto f) {
+        for (uint32_t l = 0; l < stride; l += WIDTH)
+        {
+            V value = f(l);
+            storev(dst + l, full ? value : blend(loadv(dst + l), value, loadv(m + l)));
+        }
+    };
+    auto writeReg = [&](uint8_t r, auto f) {
+        if (r != 0)
+            write(row(r), f);
+    };
+
+    // add/sub/addi: lane ที่ overflow ไม่เขียนผลและจบด้วย error
+    auto checked = [&](uint8_t r, auto f, const char *what) {
+        vector<int32_t> &overflow = scratch;
+        int32_t *dst = row(r);
+        bool any = false;
+        for (uint32_t l = 0; l < stride; l += WIDTH)
+        {
+            V over = zero(), value = f(l, over);
+            V ok = andnot(over, loadv(m + l));
+            storev(overflow.data() + l, andv(over, loadv(m + l)));
+            any |= bits(andv(over, loadv(m + l))) != 0;
+            if (r != 0)
+                storev(dst + l, blend(loadv(dst + l), value, ok));
+        }
+        if (any)
+        {
+            flush(group);
+            for (uint32_t lane = 0; lane < lanes; lane++)
+            {
+                if (overflow[lane])
+                {
+                    executed[lane]--;
+                    remove(lane, group.pc, atPC(what, at));
+                }
+            }
+        }
+    };
+
+    switch (in.op)
+    {
+    case OP_ADD:
+        checked(in.rd, [&](uint32_t l, V &over) {
+            V a = loadv(rs + l), b = loadv(rt + l), r = add(a, b);
+            over = sra(andv(xorv(a, r), xorv(b, r)), 31); // เครื่องหมายของผลต่างจาก a และ b
+            return r;
+        }, "Integer overflow in add");
+        break;
+    case OP_SUB:
+        checked(in.rd, [&](uint32_t l, V &over) {
+            V a = loadv(rs + l), b = loadv(rt + l), r = sub(a, b);
+            over = sra(andv(xorv(a, b), xorv(a, r)), 31);
+            return r;
+        }, "Integer overflow in sub");
+        break;
+    case OP_ADDI:
+        checked(in.rt, [&](uint32_t l, V &over) {
+            V a = loadv(rs + l), r = add(a, imm);
+            over = sra(andv(xorv(a, r), xorv(imm, r)), 31);
+            return r;
+        }, "Integer overflow in addi");
+        break;
+    case OP_ADDU:
+        writeReg(in.rd, [&](uint32_t l) { return add(loadv(rs + l), loadv(rt + l)); });
+        break;
+    case OP_SUBU:
+        writeReg(in.rd, [&](uint32_t l) { return sub(loadv(rs + l), loadv(rt + l)); });
+        break;
+    case OP_MUL:
+        writeReg(in.rd, [&](uint32_t l) { return mul(loadv(rs + l), loadv(rt + l)); });
+        break;
+    case OP_AND:
+        writeReg(in.rd, [&](uint32_t l) { return andv(loadv(rs + l), loadv(rt + l)); });
+        break;
+    case OP_OR:
+        writeReg(in.rd, [&](uint32_t l) { return orv(loadv(rs + l), loadv(rt + l)); });
+        break;
+    case OP_XOR:
+        writeReg(in.rd, [&](uint32_t l) { return xorv(loadv(rs + l), loadv(rt + l)); });
+        break;
+    case OP_NOR:
+        writeReg(in.rd, [&](uint32_t l) { return xorv(orv(loadv(rs + l), loadv(rt + l)), set1(-1)); });
+        break;
+    case OP_SLT: // ผลของ compare เป็น -1 / 0 ต้องได้ 1 / 0
+        writeReg(in.rd, [&](uint32_t l) { return andv(lt(loadv(rs + l), loadv(rt + l)), set1(1)); });
+        break;
+    case OP_SLTU:
+        writeReg(in.rd, [&](uint32_t l) { return andv(ltu(loadv(rs + l), loadv(rt + l)), set1(1)); });
+        break;
+    case OP_SLL:
+        writeReg(in.rd, [&](uint32_t l) { return sll(loadv(rt + l), in.imm); });
+        break;
+    case OP_SRL:
+        writeReg(in.rd, [&](uint32_t l) { return srl(loadv(rt + l), in.imm); });
+        break;
+    case OP_SRA:
+        writeReg(in.rd, [&](uint32_t l) { return sra(loadv(rt + l), in.imm); });
+        break;
+    case OP_SLLV:
+        writeReg(in.rd, [&](uint32_t l) { return sllv(loadv(rt + l), loadv(rs + l)); });
+        break;
+    case OP_SRLV:
+        writeReg(in.rd, [&](uint32_t l) { return srlv(loadv(rt + l), loadv(rs + l)); });
+        break;
+    case OP_SRAV:
+        writeReg(in.rd, [&](uint32_t l) { return srav(loadv(rt + l), loadv(rs + l)); });
+        break;
+    case OP_ADDIU:
+        writeReg(in.rt, [&](uint32_t l) { return add(loadv(rs + l), imm); });
+        break;
+    case OP_SLTI:
+        writeReg(in.rt, [&](uint32_t l) { return andv(lt(loadv(rs + l), imm), set1(1)); });
+        break;
+    case OP_SLTIU:
+        writeReg(in.rt, [&](uint32_t l) { return andv(ltu(loadv(rs + l), imm), set1(1)); });
+        break;
+    case OP_ANDI:
+        writeReg(in.rt, [&](uint32_t l) { return andv(loadv(rs + l), imm); });
+        break;
+    case OP_ORI:
+        writeReg(in.rt, [&](uint32_t l) { return orv(loadv(rs + l), imm); });
+        break;
+    case OP_XORI:
+        writeReg(in.rt, [&](uint32_t l) { return xorv(loadv(rs + l), imm); });
+        break;
+    case OP_LI:
+        writeReg(in.rt, [&](uint32_t) { return imm; });
+        break;
+    case OP_MFHI:
+        writeReg(in.rd, [&](uint32_t l) { return loadv(hi.data() + l); });
+        break;
+    case OP_MFLO:
+        writeReg(in.rd, [&](uint32_t l) { return loadv(lo.data() + l); });
+        break;
+    case OP_MTHI:
+        write(hi.data(), [&](uint32_t l) { return loadv(rs + l); });
+        break;
+    case OP_MTLO:
+        write(lo.data(), [&](uint32_t l) { return loadv(rs + l); });
+        break;
+    case OP_MOVZ:
+    case OP_MOVN:
+        if (in.rd != 0)
+        {
+            int32_t *dst = row(in.rd);
+            for (uint32_t l = 0; l < stride; l += WIDTH)
+            {
+                V zero_rt = eq(loadv(rt + l), zero());
+                V take = in.op == OP_MOVZ ? andv(zero_rt, loadv(m + l)) : andnot(zero_rt, loadv(m + l));
+                storev(dst + l, blend(loadv(dst + l), loadv(rs + l), take));
+            }
+        }
+        break;
+
+    // branch: นับ lane ที่กระโดด ถ้าไม่ใช่ทั้งหมดหรือไม่มีเลย แยกกลุ่มแล้วรวมกลับที่ post-dominator
+    case OP_BEQ:
+    case OP_BNE:
+    case OP_BLTZ:
+    case OP_BGEZ:
+    case OP_BLEZ:
+    case OP_BGTZ:
+    case OP_BLTZAL:
+    case OP_BGEZAL:
+    {
+        uint32_t taken = 0;
+        for (uint32_t l = 0; l < stride; l += WIDTH)
+        {
+            V a = loadv(rs + l), cond;
+            bool negate = false;
+            switch (in.op)
+            {
+            case OP_BEQ: cond = eq(a, loadv(rt + l)); break;
+            case OP_BNE: cond = eq(a, loadv(rt + l)); negate = true; break;
+            case OP_BLTZ:
+            case OP_BLTZAL: cond = lt(a, zero()); break;
+            case OP_BGEZ:
+            case OP_BGEZAL: cond = lt(a, zero()); negate = true; break;
+            case OP_BLEZ: cond = lt(zero(), a); negate = true; break;
+            default: cond = lt(zero(), a); break; // bgtz
+            }
+            V take = negate ? andnot(cond, loadv(m + l)) : andv(cond, loadv(m + l));
+            storev(scratch.data() + l, take);
+            taken += popcount(bits(take));
+        }
+        if (in.op == OP_BLTZAL || in.op == OP_BGEZAL)
+            writeReg(31, [&](uint32_t) { return set1((int32_t)group.pc); });
+        uint32_t target = group.pc + ((uint32_t)in.imm << 2);
+        if (taken == 0)
+            break;
+        if (taken == group.active)
+        {
+            if (in.op == OP_BLTZAL || in.op == OP_BGEZAL)
+                call(group, target); // bal = เรียก function
+            else
+                group.pc = target;
+            break;
+        }
+        // แยกกลุ่ม: กลุ่มเดิมรอที่จุดรวม กลุ่มที่ไม่กระโดดทำก่อน
+        flush(group);
+        divergences++;
+        uint32_t join = reconverge_at[(at - code_base) / 4];
+        if (join == NO_PC)
+            join = group.reconverge;
+        vector<int32_t> where(stride, 0);
+        for (uint32_t lane = 0; lane < lanes; lane++)
+            where[lane] = (int32_t)(scratch[lane] ? target : group.pc);
+        vector<int32_t> mask = group.mask;
+        group.pc = join;
+        split(where, mask, join);
+        break;
+    }
+
+    case OP_J:
+        group.pc = (uint32_t)in.imm << 2;
+        break;
+    case OP_JAL:
+        writeReg(31, [&](uint32_t) { return set1((int32_t)group.pc); });
+        call(group, (uint32_t)in.imm << 2);
+        break;
+    case OP_JR:
+    case OP_JALR:
+    {
+        // ทุก lane ไปที่เดียวกับ lane แรกหรือไม่ (อ่าน target ก่อนเขียน $rd เพราะ jalr $rd, $rd ได้)
+        uint32_t first = 0;
+        while (!m[first])
+            first++;
+        const V to = set1(rs[first]);
+        bool same = true;
+        for (uint32_t l = 0; l < stride && same; l += WIDTH)
+            same = bits(andnot(eq(loadv(rs + l), to), loadv(m + l))) == 0;
+        vector<int32_t> where;
+        if (!same)
+            where.assign(rs, rs + stride);
+        uint32_t back = group.pc;
+        if (in.op == OP_JALR)
+            writeReg(in.rd, [&](uint32_t) { return set1((int32_t)back); });
+        if (same)
+        {
+            if (in.op == OP_JALR)
+                call(group, (uint32_t)rs[first]);
+            else
+                group.pc = (uint32_t)rs[first];
+            break;
+        }
+        flush(group);
+        divergences++;
+        vector<int32_t> mask = group.mask;
+        if (in.op == OP_JALR) // เรียก function คนละตัว: รวมกลับที่ return address
+        {
+            group.pc = back;
+            split(where, mask, back);
+        }
+        else // jr คนละที่: กลุ่มเดิมหายไป แต่ละกลุ่มรวมกลับที่จุดรวมของกลุ่มเดิม
+        {
+            uint32_t join = group.reconverge;
+            stack.pop_back();
+            split(where, mask, join);
+        }
+        break;
+    }
+
+    default:
+        laneOp(group, in, at);
+        break;
+    }
+}
+
+/*  เรียก function (jal / jalr / bal ที่ทุก lane ไปที่เดียวกัน): กลุ่มเดิมรอที่ return address
+    แล้วดันกลุ่มใหม่ที่รวมกลับที่ return address ทำให้ branch ใน function ที่ไม่มีจุดรวม (return หลายที่) รวมกันได้ตอน return
+    ตอน return กลุ่มใหม่คืน steps / budget ให้กลุ่มเดิม (lane หายไปจากทั้งสองกลุ่มพร้อมกันเสมอ mask จึงเท่ากันตลอด)
+*/
+void LockstepCPU::call(Group &group, uint32_t target)
+{
+    Group callee;
+    callee.pc = target;
+    callee.reconverge = group.pc;
+    callee.mask = group.mask;
+    callee.active = group.active;
+    callee.steps = group.steps; // lane ชุดเดียวกัน ย้ายจำนวนคำสั่งที่ค้างไปนับต่อ ไม่ต้อง flush
+    callee.budget = group.budget;
+    callee.inherit = true;
+    group.steps = 0;
+    stack.push_back(move(callee));
+}
+
+// คำสั่งที่ทำทีละ lane: load/store, mult/div, clz/clo, teq, ll/sc
+void LockstepCPU::laneOp(Group &group, const Instr &in, uint32_t at)
+{
+    for (uint32_t lane = 0; lane < lanes; lane++)
+    {
+        if (!group.mask[lane])
+            continue;
+        uint32_t rs = (uint32_t)reg(lane, in.rs);
+        uint32_t rt = (uint32_t)reg(lane, in.rt);
+        uint32_t addr = rs + (uint32_t)in.imm;
+        Memory &mem = memory[lane];
+        int32_t result = 0;
+        bool write_rt = false;
+        try
+        {
+            switch (in.op)
+            {
+            case OP_MULT:
+            case OP_MULTU:
+            case OP_MADD:
+            case OP_MADDU:
+            case OP_MSUB:
+            case OP_MSUBU:
+            {
+                bool is_signed = in.op == OP_MULT || in.op == OP_MADD || in.op == OP_MSUB;
+                uint64_t product = is_signed ? (uint64_t)((int64_t)(int32_t)rs * (int32_t)rt) : (uint64_t)rs * rt;
+                uint64_t acc = ((uint64_t)(uint32_t)hi[lane] << 32) | (uint32_t)lo[lane];
+                if (in.op == OP_MADD || in.op == OP_MADDU)
+                    product = acc + product;
+                else if (in.op == OP_MSUB || in.op == OP_MSUBU)
+                    product = acc - product;
+                hi[lane] = (int32_t)(uint32_t)(product >> 32);
+                lo[lane] = (int32_t)(uint32_t)product;
+                break;
+            }
+            case OP_DIV:
+                if (rt == 0)
+                    break;
+                if ((int32_t)rs == INT32_MIN && (int32_t)rt == -1)
+                {
+                    lo[lane] = INT32_MIN;
+                    hi[lane] = 0;
+                }
+                else
+                {
+                    lo[lane] = (int32_t)rs / (int32_t)rt;
+                    hi[lane] = (int32_t)rs % (int32_t)rt;
+                }
+                break;
+            case OP_DIVU:
+                if (rt != 0)
+                {
+                    lo[lane] = (int32_t)(rs / rt);
+                    hi[lane] = (int32_t)(rs % rt);
+                }
+                break;
+            case OP_CLZ:
+            case OP_CLO:
+            {
+                uint32_t value = in.op == OP_CLZ ? rs : ~rs;
+                int32_t count = 0;
+                while (count < 32 && (value & 0x80000000u) == 0)
+                {
+                    value <<= 1;
+                    count++;
+                }
+                if (in.rd != 0)
+                    reg(lane, in.rd) = count;
+                break;
+            }
+            case OP_TEQ:
+                if (rs == rt)
+                    throw runtime_error(atPC("Trap (teq)", at));
+                break;
+            case OP_LW:
+                result = (int32_t)mem.read32(addr);
+                write_rt = true;
+                break;
+            case OP_LB:
+                result = (int8_t)mem.read8(addr);
+                write_rt = true;
+                break;
+            case OP_LBU:
+                result = mem.read8(addr);
+                write_rt = true;
+                break;
+            case OP_LH:
+                result = (int16_t)mem.read16(addr);
+                write_rt = true;
+                break;
+            case OP_LHU:
+                result = mem.read16(addr);
+                write_rt = true;
+                break;
+            case OP_LL:
+                link_value[lane] = mem.read32(addr);
+                link_addr[lane] = addr;
+                link_valid[lane] = 1;
+                result = (int32_t)link_value[lane];
+                write_rt = true;
+                break;
+            case OP_SW:
+            case OP_SB:
+            case OP_SH:
+            case OP_SC:
+                if (addr - code_base < code_limit)
+                    throw runtime_error(atPC("Store into program text is not supported by the lockstep engine", at));
+                if (in.op == OP_SW)
+                    mem.write32(addr, rt);
+                else if (in.op == OP_SB)
+                    mem.write8(addr, (uint8_t)rt);
+                else if (in.op == OP_SH)
+                    mem.write16(addr, (uint16_t)rt);
+                else
+                {
+                    bool ok = link_valid[lane] && link_addr[lane] == addr && mem.compareExchange32(addr, link_value[lane], rt);
+                    link_valid[lane] = 0;
+                    result = ok ? 1 : 0;
+                    write_rt = true;
+                }
+                break;
+            default: // OP_INVALID
+            {
+                ostringstream msg;
+                msg << "Unsupported instruction 0x" << hex << (uint32_t)in.imm;
+                throw runtime_error(atPC(msg.str(), at));
+            }
+            }
+            if (write_rt && in.rt != 0)
+                reg(lane, in.rt) = result;
+        }
+        catch (const exception &e) // lane นี้จบด้วย error ที่เหลือทำต่อ
+        {
+            flush(group);
+            executed[lane]--;
+            remove(lane, group.pc, e.what());
+        }
+    }
+}
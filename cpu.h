@@ -0,0 +1,2370 @@
+/*  แกนของ CPU simulator (library cpu_core): ชนิดข้อมูลของโปรแกรม, memory, cache, pipeline, profile, trace,
+    class CPU, checkpoint และ multi-core  ตัวโปรแกรม sim_cpu (CLI) อยู่ใน sim_cpu.cpp
+*/
+#ifndef SIM_CPU_H
+#define SIM_CPU_H
+
+#include <iostream>
+#include <unordered_map>
+#include <unordered_set>
+#include <sstream>
+#include <functional>
+#include <algorithm>
+#include <vector>
+#include <cstdint>
+#include <stdexcept>
+#include <fstream>
+#include <climits>
+#include <array>
+#include <utility>
+#include <memory>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+#include <exception>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#include <cstring>
+#include <cstdio>
+#ifndef _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+// บังคับ inline สำหรับฟังก์ชันใน hot path (compiler มักไม่ยอม inline switch ใหญ่ๆ เอง)
+#if defined(__GNUC__)
+#define SIM_INLINE inline __attribute__((always_inline))
+#elif defined(_MSC_VER)
+#define SIM_INLINE __forceinline
+#else
+#define SIM_INLINE inline
+#endif
+
+/*  SIM_PROFILE=1 ตอน compile (g++ -DSIM_PROFILE=1) เปิดตัวนับของ --profile (ดู class Profile)
+    build ปกติ SIM_PROFILE_HOOK หายไปทั้งหมด hot path ไม่ต้องเช็คอะไรเพิ่ม
+*/
+#ifndef SIM_PROFILE
+#define SIM_PROFILE 0
+#endif
+#if SIM_PROFILE
+#define SIM_PROFILE_HOOK(profile, call) \
+    do                                  \
+    {                                   \
+        if (profile)                    \
+            (profile)->call;            \
+    } while (0)
+#else
+#define SIM_PROFILE_HOOK(profile, call) \
+    do                                  \
+    {                                   \
+    } while (0)
+#endif
+
+// รหัสคำสั่ง (opcode) หลังถอดรหัสจาก string แล้ว ใช้ enum แทน string ตอน execute จะได้ไม่ต้อง hash ทุกครั้ง
+enum Opcode : uint8_t
+{
+    OP_ADD,
+    OP_SUB,
+    OP_MUL,
+    OP_LW,
+    OP_SW,
+    OP_LI,
+    OP_BEQ,
+    OP_BNE,
+    OP_J,
+    OP_JAL,
+    OP_JR,
+    OP_AND,
+    OP_OR,
+    OP_SLT,
+    OP_LL,      // load linked
+    OP_SC,      // store conditional
+    // ส่วนที่เหลือของ MIPS32 integer (คำสั่งที่ compiler ใช้จริง)
+    OP_ADDU,    // บวก/ลบแบบไม่ตรวจ overflow (add/sub/addi จะ trap ถ้า overflow)
+    OP_SUBU,
+    OP_XOR,
+    OP_NOR,
+    OP_SLTU,    // เทียบแบบ unsigned
+    OP_SLL,     // shift ด้วยค่าคงที่ (imm = shamt)
+    OP_SRL,
+    OP_SRA,
+    OP_SLLV,    // shift ด้วยค่าใน register
+    OP_SRLV,
+    OP_SRAV,
+    OP_MULT,    // ผล 64 bit ลง hi/lo
+    OP_MULTU,
+    OP_DIV,     // lo = ผลหาร, hi = เศษ
+    OP_DIVU,
+    OP_MADD,    // hi:lo += rs * rt
+    OP_MADDU,
+    OP_MSUB,    // hi:lo -= rs * rt
+    OP_MSUBU,
+    OP_MFHI,
+    OP_MFLO,
+    OP_MTHI,
+    OP_MTLO,
+    OP_MOVZ,    // rd = rs ถ้า rt == 0
+    OP_MOVN,    // rd = rs ถ้า rt != 0
+    OP_CLZ,
+    OP_CLO,
+    OP_ADDI,
+    OP_ADDIU,
+    OP_SLTI,
+    OP_SLTIU,
+    OP_ANDI,    // imm ของ andi/ori/xori zero-extend ไว้แล้วตอนถอดรหัส
+    OP_ORI,
+    OP_XORI,
+    OP_LB,
+    OP_LBU,
+    OP_LH,
+    OP_LHU,
+    OP_SB,
+    OP_SH,
+    OP_BLTZ,    // branch เทียบกับ 0
+    OP_BGEZ,
+    OP_BLEZ,
+    OP_BGTZ,
+    OP_BLTZAL,
+    OP_BGEZAL,
+    OP_JALR,    // rd = PC + 4 แล้วกระโดดไปที่ rs
+    OP_TEQ,     // trap ถ้า rs == rt (compiler ใส่ไว้หลัง div กันหารด้วย 0)
+    OP_INVALID, // machine code ที่ simulator ยังไม่รองรับ จะ error ตอน execute (ไม่ใช่ตอนโหลด เพราะใน text อาจมีข้อมูลปนอยู่)
+    OP_COUNT    // จำนวนคำสั่งทั้งหมด
+};
+
+/*  คำสั่งที่ถอดรหัส (decode) แล้ว ขนาดคงที่ 8 byte ต่อคำสั่ง
+    rd, rs, rt = index ของ register (0-31) ที่ค้นจาก reg_map ไว้แล้ว
+    imm = ค่าคงที่ที่ sign-extend แล้ว ใช้เป็น offset ของ load/store/branch, ค่าของ li, target ของ j/jal
+          shamt ของ sll/srl/sra และค่าแบบ zero-extend ของ andi/ori/xori (lui ถอดรหัสเป็น li ที่ shift ไว้แล้ว)
+*/
+struct Instr
+{
+    uint8_t op = OP_ADD;
+    uint8_t rd = 0;
+    uint8_t rs = 0;
+    uint8_t rt = 0;
+    int32_t imm = 0;
+};
+
+// กลุ่มของคำสั่ง ใช้ร่วมกันใน pipeline, trace และ block cache
+constexpr bool isLoad(uint8_t op)
+{
+    return op == OP_LW || op == OP_LL || op == OP_LB || op == OP_LBU || op == OP_LH || op == OP_LHU;
+}
+constexpr bool isStore(uint8_t op)
+{
+    return op == OP_SW || op == OP_SC || op == OP_SB || op == OP_SH;
+}
+// branch แบบมีเงื่อนไข (ทายได้ด้วย branch predictor)
+constexpr bool isBranch(uint8_t op)
+{
+    return op == OP_BEQ || op == OP_BNE || (op >= OP_BLTZ && op <= OP_BGEZAL);
+}
+
+// ข้อมูลที่ต้องโหลดลง memory ก่อนรัน (segment ของไฟล์ ELF / binary หรือ .data ของไฟล์ .asm)
+struct Segment
+{
+    uint32_t addr = 0;     // byte address เริ่มต้น
+    vector<uint8_t> bytes; // ข้อมูล (ส่วนที่เกิน filesz ถูกเติม 0 ไว้แล้ว)
+};
+
+/*  โปรแกรมที่แปลแล้ว (ผลของ CPU::assemble หรือ CPU::loadBinary)
+    code[i] คือคำสั่งที่ PC = text_base + i * 4
+    source_line[i] คือเลขบรรทัดในไฟล์ .asm ของ code[i] (เอาไว้บอก error / debug) ไฟล์ binary จะว่าง
+    labels เก็บ label ใน text -> word address, data_labels เก็บ label ใน .data -> byte address
+    entry = PC เริ่มต้น, data = ข้อมูลที่ต้องเขียนลง memory ตอน CPU::load
+*/
+struct Program
+{
+    vector<Instr> code;
+    vector<int> source_line;
+    unordered_map<string, int> labels;
+    unordered_map<string, uint32_t> data_labels;
+    uint32_t text_base = 0;
+    uint32_t entry = 0;
+    vector<Segment> data;
+
+    // PC นี้ชี้อยู่ในโปรแกรมหรือไม่ (ถ้าไม่ = จบโปรแกรม) PC ที่ต่ำกว่า text_base จะกลายเป็นเลขมากเมื่อ cast เป็น unsigned
+    bool contains(int pc) const { return ((uint32_t)pc - text_base) / 4 < code.size(); }
+
+    // true = text อยู่ใน memory เดียวกับ data (ไฟล์ binary) sw ที่เขียนทับ text จะเปลี่ยนคำสั่งด้วย
+    // false = .asm แยก instruction memory กับ data memory (address 0 ของ data ไม่ใช่คำสั่งแรก)
+    bool code_in_memory = false;
+};
+
+class CPU;
+struct ThreadedOp;
+using Handler = void (*)(CPU &, const ThreadedOp &); // ฟังก์ชันที่ทำงานคำสั่งนั้นๆ (เลือกไว้แล้วตอนแปล block)
+
+/*  1 คำสั่งใน threaded code: handler ที่ผูกไว้แล้ว + operand
+    superinstruction (เช่น slt+bne) ใช้ทั้ง in และ in2 ใน handler เดียว length = 2
+*/
+struct ThreadedOp
+{
+    Handler fn = nullptr;
+    Instr in;
+    Instr in2;
+    uint32_t pc = 0;     // address ของ in (in2 อยู่ที่ pc + 4)
+    uint8_t length = 1;
+};
+
+// basic block = คำสั่งที่ทำต่อกันเรื่อยๆ จนเจอ branch/jump แปลครั้งเดียวแล้วเก็บไว้ใน cache ตาม PC เริ่มต้น
+struct Block
+{
+    uint32_t start = 0;      // index ของคำสั่งแรก
+    uint32_t count = 0;      // จำนวนคำสั่ง (นับ superinstruction เป็น 2)
+    uint32_t end_pc = 0;     // PC หลังคำสั่งสุดท้าย (ใช้เมื่อคำสั่งสุดท้ายไม่ได้เปลี่ยน PC เอง)
+    bool sets_pc = false;    // คำสั่งสุดท้ายเป็น branch/jump ที่ตั้ง PC เอง
+    bool valid = true;       // false = ถูกเขียนทับโดย sw แล้ว (ช่องนี้ว่าง translate ครั้งถัดไปใช้ซ้ำ)
+    vector<ThreadedOp> ops;
+};
+
+// error จากการเข้าถึง memory (address ไม่ตรง alignment หรืออยู่นอกพื้นที่ของโปรแกรม)
+class MemoryFault : public runtime_error
+{
+public:
+    uint32_t addr;
+    MemoryFault(const string &what, uint32_t address) : runtime_error(what), addr(address) {}
+};
+
+/*  ที่เก็บ page จริงของ memory 32 bit ใช้ร่วมกันได้หลาย core (หลาย thread)
+    page table 2 ชั้น: address 10 bit บน = directory, 10 bit กลาง = table, 12 bit ล่าง = offset ใน page
+    จอง page ขนาด 4KB ตอนเขียนครั้งแรก (ใช้ mutex ตอนจอง) ส่วนการหา page อ่าน pointer แบบ atomic ไม่ต้อง lock
+*/
+class PageStore
+{
+public:
+    static constexpr uint32_t PAGE_BITS = 12;
+    static constexpr uint32_t PAGE_SIZE = 1u << PAGE_BITS;
+
+    struct Page
+    {
+        uint8_t bytes[PAGE_SIZE];
+    };
+
+    PageStore()
+    {
+        for (auto &table : directory)
+            table.store(nullptr, memory_order_relaxed);
+    }
+
+    ~PageStore()
+    {
+        for (auto &entry : directory)
+        {
+            Table *table = entry.load(memory_order_relaxed);
+            if (!table)
+                continue;
+            for (auto &page : table->pages)
+            {
+                Page *p = page.load(memory_order_relaxed);
+                if (!borrowed.count(p))
+                    delete p;
+            }
+            delete table;
+        }
+    }
+
+    PageStore(const PageStore &) = delete;
+    PageStore &operator=(const PageStore &) = delete;
+
+    // page ที่มี addr อยู่ (nullptr = ยังไม่เคยเขียน)
+    Page *find(uint32_t addr) const
+    {
+        const Table *table = directory[addr >> 22].load(memory_order_acquire);
+        return table ? table->pages[(addr >> PAGE_BITS) & 1023].load(memory_order_acquire) : nullptr;
+    }
+
+    // หา page ถ้ายังไม่มีก็จองใหม่ (เติม 0 ทั้ง page)
+    Page *allocate(uint32_t addr)
+    {
+        Page *page = find(addr);
+        if (page)
+            return page;
+
+        lock_guard<mutex> guard(lock);
+        atomic<Page *> &page_entry = slot(addr);
+        page = page_entry.load(memory_order_relaxed);
+        if (!page) // thread อื่นอาจจองไปแล้วระหว่างรอ lock
+        {
+            page = new Page();
+            page_entry.store(page, memory_order_release);
+            page_count++;
+        }
+        return page;
+    }
+
+    size_t pageCount() const { return page_count.load(); }
+
+    /*  ใช้ page จาก buffer ภายนอก (เช่นไฟล์ checkpoint ที่ mmap ไว้) เป็น page ของ addr โดยไม่ copy
+        owner คือเจ้าของ buffer จะถูกเก็บไว้จนกว่า PageStore จะถูกลบ ต้องเรียกก่อนเริ่มรัน (addr ต้องยังไม่มี page)
+    */
+    void borrow(uint32_t addr, Page *page, const shared_ptr<void> &owner)
+    {
+        lock_guard<mutex> guard(lock);
+        atomic<Page *> &page_entry = slot(addr);
+        if (page_entry.load(memory_order_relaxed))
+            throw runtime_error("Page already allocated");
+        page_entry.store(page, memory_order_release);
+        borrowed.insert(page);
+        if (owners.empty() || owners.back() != owner)
+            owners.push_back(owner);
+        page_count++;
+    }
+
+    // เรียก fn(address ของ page, page) ทุก page ที่จองแล้ว เรียงตาม address
+    void forEachPage(const function<void(uint32_t, const Page &)> &fn) const
+    {
+        for (uint32_t d = 0; d < 1024; d++)
+        {
+            const Table *table = directory[d].load(memory_order_acquire);
+            if (!table)
+                continue;
+            for (uint32_t t = 0; t < 1024; t++)
+            {
+                const Page *page = table->pages[t].load(memory_order_acquire);
+                if (page)
+                    fn((d << 22) | (t << PAGE_BITS), *page);
+            }
+        }
+    }
+
+private:
+    struct Table
+    {
+        atomic<Page *> pages[1024];
+    };
+
+    atomic<Table *> directory[1024];
+    mutex lock;
+    atomic<size_t> page_count{0};
+    unordered_set<Page *> borrowed;     // page ที่ไม่ได้จองเอง (ห้าม delete)
+    vector<shared_ptr<void>> owners;    // เจ้าของ page ที่ borrow มา
+
+    // ช่องของ page ที่มี addr ใน page table (สร้าง table ถ้ายังไม่มี) ต้องถือ lock อยู่
+    atomic<Page *> &slot(uint32_t addr)
+    {
+        atomic<Table *> &table_entry = directory[addr >> 22];
+        Table *table = table_entry.load(memory_order_relaxed);
+        if (!table)
+        {
+            table = new Table();
+            for (auto &entry : table->pages)
+                entry.store(nullptr, memory_order_relaxed);
+            table_entry.store(table, memory_order_release);
+        }
+        return table->pages[(addr >> PAGE_BITS) & 1023];
+    }
+};
+
+/*  Memory แบบ byte address ขนาด 32 bit (4GB) ของ CPU 1 ตัว จองจริงทีละ page 4KB เมื่อมีการเขียนครั้งแรก (ดู PageStore)
+    อ่าน page ที่ยังไม่เคยเขียนจะได้ 0 (ไม่จอง page) เก็บ page ล่าสุดที่อ่าน/เขียนไว้ จะได้ไม่ต้องเดิน page table ทุกครั้ง
+    หลาย CPU ใช้ PageStore เดียวกันได้ (share) แต่ละตัวมี cache ของ page ล่าสุดของตัวเอง
+    byte order เป็น little endian
+*/
+class Memory
+{
+public:
+    static constexpr uint32_t PAGE_BITS = PageStore::PAGE_BITS;
+    static constexpr uint32_t PAGE_SIZE = PageStore::PAGE_SIZE;
+    static constexpr uint32_t USER_LIMIT = 0x80000000u; // address ตั้งแต่ 0x80000000 เป็นของ kernel โปรแกรมเข้าไม่ได้
+
+    // ใช้ page ชุดเดียวกับ other (multi-core)
+    void share(const Memory &other)
+    {
+        store = other.store;
+        read_vpn = write_vpn = 0xFFFFFFFFu;
+    }
+
+    SIM_INLINE uint8_t read8(uint32_t addr) { return *readPtr(addr); }
+    SIM_INLINE uint16_t read16(uint32_t addr)
+    {
+        checkAlign(addr, 2);
+        uint16_t value;
+        memcpy(&value, readPtr(addr), 2);
+        return fromLittle16(value);
+    }
+    SIM_INLINE uint32_t read32(uint32_t addr)
+    {
+        checkAlign(addr, 4);
+        uint32_t value;
+        memcpy(&value, readPtr(addr), 4);
+        return fromLittle32(value);
+    }
+
+    SIM_INLINE void write8(uint32_t addr, uint8_t value) { *writePtr(addr) = value; }
+    SIM_INLINE void write16(uint32_t addr, uint16_t value)
+    {
+        checkAlign(addr, 2);
+        value = fromLittle16(value);
+        memcpy(writePtr(addr), &value, 2);
+    }
+    SIM_INLINE void write32(uint32_t addr, uint32_t value)
+    {
+        checkAlign(addr, 4);
+        value = fromLittle32(value);
+        memcpy(writePtr(addr), &value, 4);
+    }
+
+    // เขียน desired ถ้าค่าใน memory ยังเป็น expected แบบ atomic (ใช้ทำ sc) คืน true ถ้าเขียนได้
+    bool compareExchange32(uint32_t addr, uint32_t expected, uint32_t desired)
+    {
+        checkAlign(addr, 4);
+        uint32_t *word = (uint32_t *)writePtr(addr);
+        expected = fromLittle32(expected);
+        desired = fromLittle32(desired);
+#if defined(_MSC_VER)
+        return (uint32_t)_InterlockedCompareExchange((volatile long *)word, (long)desired, (long)expected) == expected;
+#else
+        return __atomic_compare_exchange_n(word, &expected, desired, false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+#endif
+    }
+
+    // เขียนข้อมูลหลาย byte (ใช้ตอนโหลดโปรแกรม) ข้าม page ได้
+    void writeBytes(uint32_t addr, const uint8_t *bytes, size_t size)
+    {
+        for (size_t i = 0; i < size; i++)
+            write8(addr + (uint32_t)i, bytes[i]);
+    }
+
+    size_t pageCount() const { return store->pageCount(); } // จำนวน page ที่จองไปแล้ว
+    PageStore &pages() { return *store; }                     // page ทั้งหมด (ใช้ตอน checkpoint)
+    const PageStore &pages() const { return *store; }
+
+private:
+    shared_ptr<PageStore> store = make_shared<PageStore>();
+
+    // page ล่าสุด (vpn = address >> 12) แยกอ่านกับเขียน เพราะอ่าน page ที่ยังไม่จองจะชี้ไปที่ zero_page
+    uint32_t read_vpn = 0xFFFFFFFFu;
+    const uint8_t *read_page = nullptr;
+    uint32_t write_vpn = 0xFFFFFFFFu;
+    uint8_t *write_page = nullptr;
+
+    static const uint8_t *zeroPage()
+    {
+        static const PageStore::Page zero = {};
+        return zero.bytes;
+    }
+
+    static SIM_INLINE uint16_t fromLittle16(uint16_t v)
+    {
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+        return __builtin_bswap16(v);
+#else
+        return v;
+#endif
+    }
+    static SIM_INLINE uint32_t fromLittle32(uint32_t v)
+    {
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+        return __builtin_bswap32(v);
+#else
+        return v;
+#endif
+    }
+
+    static SIM_INLINE void checkAlign(uint32_t addr, uint32_t size)
+    {
+        if (addr & (size - 1))
+            throw MemoryFault("Unaligned " + to_string(size) + "-byte access at " + hexAddr(addr), addr);
+    }
+
+    static string hexAddr(uint32_t addr)
+    {
+        ostringstream out;
+        out << "0x" << hex << addr;
+        return out.str();
+    }
+
+    static void checkRange(uint32_t addr)
+    {
+        if (addr >= USER_LIMIT)
+            throw MemoryFault("Address out of range " + hexAddr(addr), addr);
+    }
+
+    // fast path: อยู่ใน page เดียวกับครั้งก่อน ไม่ต้องเดิน page table (page ที่เกินขอบเขตไม่มีทางอยู่ใน cache)
+    SIM_INLINE const uint8_t *readPtr(uint32_t addr)
+    {
+        if ((addr >> PAGE_BITS) == read_vpn)
+            return read_page + (addr & (PAGE_SIZE - 1));
+        return readSlow(addr);
+    }
+
+    SIM_INLINE uint8_t *writePtr(uint32_t addr)
+    {
+        if ((addr >> PAGE_BITS) == write_vpn)
+            return write_page + (addr & (PAGE_SIZE - 1));
+        return writeSlow(addr);
+    }
+
+    const uint8_t *readSlow(uint32_t addr)
+    {
+        checkRange(addr);
+        PageStore::Page *page = store->find(addr);
+        // page ที่ยังไม่มีไม่เก็บไว้ใน cache เพราะ core อื่นอาจจองแล้วเขียนทีหลัง
+        if (!page)
+            return zeroPage() + (addr & (PAGE_SIZE - 1));
+        read_vpn = addr >> PAGE_BITS;
+        read_page = page->bytes;
+        return read_page + (addr & (PAGE_SIZE - 1));
+    }
+
+    uint8_t *writeSlow(uint32_t addr)
+    {
+        checkRange(addr);
+        PageStore::Page *page = store->allocate(addr);
+        write_vpn = addr >> PAGE_BITS;
+        write_page = page->bytes;
+        return write_page + (addr & (PAGE_SIZE - 1));
+    }
+};
+
+/*  ตัวช่วยเขียน/อ่านสถานะของ checkpoint: ค่าแต่ละตัวเรียงต่อกันเป็น byte ตามลำดับที่เขียน (byte order ของ host)
+    vector / string เก็บความยาวก่อนแล้วตามด้วยข้อมูล ถ้าอ่านเกินท้ายข้อมูลจะ throw
+*/
+class StateWriter
+{
+public:
+    vector<uint8_t> bytes;
+
+    template <typename T>
+    void put(const T &value)
+    {
+        const uint8_t *p = (const uint8_t *)&value;
+        bytes.insert(bytes.end(), p, p + sizeof(T));
+    }
+
+    template <typename T>
+    void putVector(const vector<T> &values)
+    {
+        put((uint64_t)values.size());
+        const uint8_t *p = (const uint8_t *)values.data();
+        bytes.insert(bytes.end(), p, p + values.size() * sizeof(T));
+    }
+
+    void putString(const string &text)
+    {
+        put((uint64_t)text.size());
+        bytes.insert(bytes.end(), text.begin(), text.end());
+    }
+};
+
+class StateReader
+{
+public:
+    StateReader(const uint8_t *data, size_t size) : pos(data), end(data + size) {}
+
+    template <typename T>
+    T get()
+    {
+        T value;
+        memcpy(&value, take(sizeof(T)), sizeof(T));
+        return value;
+    }
+
+    template <typename T>
+    void getVector(vector<T> &values)
+    {
+        uint64_t count = get<uint64_t>();
+        if (count > (uint64_t)(end - pos) / sizeof(T))
+            throw runtime_error("Corrupt checkpoint");
+        values.resize((size_t)count);
+        memcpy(values.data(), take((size_t)count * sizeof(T)), (size_t)count * sizeof(T));
+    }
+
+    string getString()
+    {
+        uint64_t size = get<uint64_t>();
+        if (size > (uint64_t)(end - pos))
+            throw runtime_error("Corrupt checkpoint");
+        const char *p = (const char *)take((size_t)size);
+        return string(p, p + size);
+    }
+
+private:
+    const uint8_t *pos;
+    const uint8_t *end;
+
+    const uint8_t *take(size_t size)
+    {
+        if (size > (size_t)(end - pos))
+            throw runtime_error("Corrupt checkpoint");
+        const uint8_t *p = pos;
+        pos += size;
+        return p;
+    }
+};
+
+//-----------------------------------------------Cache simulator-----------------------------------------------
+
+// วิธีเลือก line ที่จะถูกไล่ออกเมื่อ set เต็ม
+enum Replacement : uint8_t
+{
+    REPL_LRU,    // ไม่ได้ใช้นานที่สุด
+    REPL_PLRU,   // tree pseudo-LRU (ใช้ bit น้อยกว่า LRU)
+    REPL_RANDOM  // สุ่ม
+};
+
+// ขนาดและนโยบายของ cache 1 ระดับ
+struct CacheConfig
+{
+    uint32_t size = 32 * 1024;  // byte
+    uint32_t ways = 8;          // associativity
+    uint32_t line = 64;         // byte ต่อ line
+    Replacement policy = REPL_LRU;
+    bool write_back = true;     // true = write-back + write-allocate, false = write-through + no-write-allocate
+    uint32_t hit_latency = 1;   // cycle
+};
+
+/*  Cache 1 ระดับ (เก็บแค่ tag ไม่เก็บข้อมูลจริง ข้อมูลอยู่ใน Memory)
+    tag / dirty / อายุของ LRU เก็บแยกเป็น array ของใครของมัน (structure of arrays) ช่องที่ set * ways + way
+    เลือก set ด้วย mask ของ bit (จำนวน set เป็นเลขยกกำลัง 2) ไม่ต้องหาร
+*/
+class Cache
+{
+public:
+    string name;
+    CacheConfig config;
+    Cache *next;                 // ระดับถัดไป (nullptr = main memory)
+
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    uint64_t evictions = 0;
+    uint64_t writebacks = 0;     // line dirty ที่ถูกเขียนกลับระดับถัดไป
+    uint64_t memory_reads = 0;   // ใช้เมื่อ next == nullptr
+    uint64_t memory_writes = 0;
+
+    Cache(const string &cache_name, const CacheConfig &cfg, Cache *next_level)
+        : name(cache_name), config(cfg), next(next_level)
+    {
+        auto pow2 = [](uint32_t v) { return v != 0 && (v & (v - 1)) == 0; };
+        if (!pow2(cfg.line) || cfg.line < 4 || cfg.ways == 0 || cfg.ways > 64 || cfg.size % (cfg.ways * cfg.line) != 0 ||
+            !pow2(cfg.size / (cfg.ways * cfg.line)))
+            throw runtime_error(name + ": size / (ways * line) must be a power of two and line a power of two >= 4");
+        if (cfg.policy == REPL_PLRU && !pow2(cfg.ways))
+            throw runtime_error(name + ": PLRU needs a power-of-two number of ways");
+
+        sets = cfg.size / (cfg.ways * cfg.line);
+        while ((1u << offset_bits) < cfg.line)
+            offset_bits++;
+        while ((1u << set_bits) < sets)
+            set_bits++;
+        tags.assign((size_t)sets * cfg.ways, INVALID);
+        dirty.assign((size_t)sets * cfg.ways, 0);
+        if (cfg.policy == REPL_LRU)
+            stamps.assign((size_t)sets * cfg.ways, 0);
+        if (cfg.policy == REPL_PLRU)
+            plru.assign(sets, 0);
+    }
+
+    // เข้าถึง address 1 ครั้ง คืน true ถ้า hit
+    SIM_INLINE bool access(uint32_t addr, bool write)
+    {
+        uint32_t line_addr = addr >> offset_bits;
+        if (line_addr == last_line) // line เดียวกับครั้งก่อน = hit และเป็น line ที่ใช้ล่าสุดอยู่แล้ว ไม่ต้องอัปเดต LRU
+        {
+            hits++;
+            if (write)
+                writeHit(last_slot, addr);
+            return true;
+        }
+        return accessSlow(addr, line_addr, write);
+    }
+
+    uint64_t accesses() const { return hits + misses; }
+    double missRate() const { return accesses() ? (double)misses / accesses() : 0.0; }
+
+    // เก็บ/คืนสถานะทั้งหมด (tag, dirty, LRU, สถิติ) config ตอนคืนต้องเหมือนตอนเก็บ
+    void save(StateWriter &out) const
+    {
+        out.put(config.size);
+        out.put(config.ways);
+        out.put(config.line);
+        out.put(config.policy);
+        out.put(config.write_back);
+        for (uint64_t v : {hits, misses, evictions, writebacks, memory_reads, memory_writes, clock})
+            out.put(v);
+        out.put(random_state);
+        out.put(last_line);
+        out.put(last_slot);
+        out.putVector(tags);
+        out.putVector(dirty);
+        out.putVector(stamps);
+        out.putVector(plru);
+    }
+
+    void restore(StateReader &in)
+    {
+        CacheConfig saved;
+        saved.size = in.get<uint32_t>();
+        saved.ways = in.get<uint32_t>();
+        saved.line = in.get<uint32_t>();
+        saved.policy = in.get<Replacement>();
+        saved.write_back = in.get<bool>();
+        if (saved.size != config.size || saved.ways != config.ways || saved.line != config.line ||
+            saved.policy != config.policy || saved.write_back != config.write_back)
+            throw runtime_error(name + " configuration differs from the checkpoint");
+        for (uint64_t *v : {&hits, &misses, &evictions, &writebacks, &memory_reads, &memory_writes, &clock})
+            *v = in.get<uint64_t>();
+        random_state = in.get<uint32_t>();
+        last_line = in.get<uint32_t>();
+        last_slot = in.get<uint32_t>();
+        in.getVector(tags);
+        in.getVector(dirty);
+        in.getVector(stamps);
+        in.getVector(plru);
+    }
+
+private:
+    static constexpr uint32_t INVALID = 0xFFFFFFFFu; // tag ของ line ว่าง (tag จริงมีไม่ถึง 32 bit)
+
+    uint32_t sets = 0;
+    uint32_t offset_bits = 0;
+    uint32_t set_bits = 0;
+    vector<uint32_t> tags;
+    vector<uint8_t> dirty;
+    vector<uint64_t> stamps; // LRU: เวลาที่ใช้ล่าสุดของแต่ละ line
+    vector<uint64_t> plru;   // PLRU: bit ของ tree ต่อ set
+    uint64_t clock = 0;
+    uint32_t random_state = 2463534242u;
+    uint32_t last_line = INVALID;
+    uint32_t last_slot = 0;
+
+    SIM_INLINE void writeHit(uint32_t slot, uint32_t addr)
+    {
+        if (config.write_back)
+            dirty[slot] = 1;
+        else
+            writeNext(addr);
+    }
+
+    void readNext(uint32_t addr)
+    {
+        if (next)
+            next->access(addr, false);
+        else
+            memory_reads++;
+    }
+
+    void writeNext(uint32_t addr)
+    {
+        if (next)
+            next->access(addr, true);
+        else
+            memory_writes++;
+    }
+
+    // บันทึกว่า way นี้ถูกใช้ล่าสุด
+    void touch(uint32_t set, uint32_t way)
+    {
+        if (config.policy == REPL_LRU)
+        {
+            stamps[(size_t)set * config.ways + way] = ++clock;
+        }
+        else if (config.policy == REPL_PLRU)
+        {
+            // เดินจาก root ลงไปหา way นี้ แล้วตั้ง bit ของแต่ละ node ให้ชี้ไปอีกฝั่ง
+            uint64_t &bits = plru[set];
+            uint32_t node = 1;
+            for (uint32_t half = config.ways / 2; half >= 1; half /= 2)
+            {
+                bool right = (way & half) != 0;
+                if (right)
+                    bits &= ~(1ull << node);
+                else
+                    bits |= 1ull << node;
+                node = node * 2 + (right ? 1 : 0);
+            }
+        }
+    }
+
+    uint32_t victim(uint32_t set)
+    {
+        size_t base = (size_t)set * config.ways;
+        for (uint32_t w = 0; w < config.ways; w++) // ใช้ line ว่างก่อน
+        {
+            if (tags[base + w] == INVALID)
+                return w;
+        }
+        if (config.policy == REPL_LRU)
+        {
+            uint32_t oldest = 0;
+            for (uint32_t w = 1; w < config.ways; w++)
+            {
+                if (stamps[base + w] < stamps[base + oldest])
+                    oldest = w;
+            }
+            return oldest;
+        }
+        if (config.policy == REPL_PLRU)
+        {
+            uint32_t node = 1, way = 0;
+            for (uint32_t half = config.ways / 2; half >= 1; half /= 2)
+            {
+                bool right = (plru[set] >> node) & 1;
+                way |= right ? half : 0;
+                node = node * 2 + (right ? 1 : 0);
+            }
+            return way;
+        }
+        random_state ^= random_state << 13; // xorshift32
+        random_state ^= random_state >> 17;
+        random_state ^= random_state << 5;
+        return random_state % config.ways;
+    }
+
+    bool accessSlow(uint32_t addr, uint32_t line_addr, bool write)
+    {
+        uint32_t set = line_addr & (sets - 1);
+        uint32_t tag = line_addr >> set_bits;
+        size_t base = (size_t)set * config.ways;
+
+        for (uint32_t w = 0; w < config.ways; w++)
+        {
+            if (tags[base + w] == tag)
+            {
+                hits++;
+                touch(set, w);
+                last_line = line_addr;
+                last_slot = (uint32_t)(base + w);
+                if (write)
+                    writeHit(last_slot, addr);
+                return true;
+            }
+        }
+
+        misses++;
+        if (write && !config.write_back) // no-write-allocate: เขียนผ่านไประดับถัดไปเลย
+        {
+            writeNext(addr);
+            return false;
+        }
+
+        readNext(addr);
+        uint32_t w = victim(set);
+        size_t slot = base + w;
+        if (tags[slot] != INVALID)
+        {
+            evictions++;
+            if (dirty[slot])
+            {
+                writebacks++;
+                writeNext(((tags[slot] << set_bits) | set) << offset_bits);
+            }
+        }
+        tags[slot] = tag;
+        dirty[slot] = write ? 1 : 0;
+        touch(set, w);
+        last_line = line_addr;
+        last_slot = (uint32_t)slot;
+        return false;
+    }
+};
+
+/*  L1I + L1D ที่ใช้ L2 ร่วมกัน แล้วต่อกับ main memory
+    fetch = อ่านคำสั่ง (L1I), data = lw/sw (L1D)
+*/
+class CacheHierarchy
+{
+public:
+    uint32_t memory_latency = 100; // cycle ของ main memory
+    Cache l2;
+    Cache l1i;
+    Cache l1d;
+
+    CacheHierarchy(const CacheConfig &l1i_cfg, const CacheConfig &l1d_cfg, const CacheConfig &l2_cfg)
+        : l2("L2", l2_cfg, nullptr), l1i("L1I", l1i_cfg, &l2), l1d("L1D", l1d_cfg, &l2)
+    {
+    }
+
+    SIM_INLINE void fetch(uint32_t addr) { l1i.access(addr, false); }
+    SIM_INLINE void data(uint32_t addr, bool write) { l1d.access(addr, write); }
+
+    void save(StateWriter &out) const
+    {
+        l1i.save(out);
+        l1d.save(out);
+        l2.save(out);
+    }
+
+    void restore(StateReader &in)
+    {
+        l1i.restore(in);
+        l1d.restore(in);
+        l2.restore(in);
+    }
+
+    // AMAT = hit time + miss rate * (AMAT ของระดับถัดไป)
+    double amat(const Cache &cache) const
+    {
+        double below = cache.next ? amat(*cache.next) : memory_latency;
+        return cache.config.hit_latency + cache.missRate() * below;
+    }
+
+    void report(ostream &out) const
+    {
+        out << "Cache statistics:\n";
+        for (const Cache *c : {&l1i, &l1d, &l2})
+        {
+            out << "  " << c->name << ": " << c->accesses() << " accesses, " << c->hits << " hits, " << c->misses
+                << " misses (" << c->missRate() * 100 << "%), " << c->evictions << " evictions, " << c->writebacks << " writebacks\n";
+        }
+        out << "  Memory: " << l2.memory_reads << " reads, " << l2.memory_writes << " writes\n";
+        out << "  AMAT instruction = " << amat(l1i) << " cycles, data = " << amat(l1d) << " cycles\n";
+    }
+};
+
+//-----------------------------------------------Pipeline timing model-----------------------------------------------
+
+// ชนิดของ branch predictor
+enum PredictorKind : uint8_t
+{
+    PRED_NOT_TAKEN, // static: ทายว่าไม่กระโดดเสมอ
+    PRED_BIMODAL,   // 2-bit counter ต่อ PC
+    PRED_GSHARE     // 2-bit counter ที่ index ด้วย PC xor global history
+};
+
+/*  Branch predictor ใช้ตาราง 2-bit saturating counter ขนาด 2^bits ช่อง
+    counter 0,1 = ทายว่าไม่กระโดด, 2,3 = ทายว่ากระโดด
+*/
+class BranchPredictor
+{
+public:
+    PredictorKind kind;
+
+    explicit BranchPredictor(PredictorKind predictor_kind = PRED_NOT_TAKEN, uint32_t bits = 12)
+        : kind(predictor_kind), mask((1u << bits) - 1), counters(1u << bits, 1)
+    {
+    }
+
+    bool predict(uint32_t pc) const
+    {
+        return kind != PRED_NOT_TAKEN && counters[index(pc)] >= 2;
+    }
+
+    void update(uint32_t pc, bool taken)
+    {
+        if (kind == PRED_NOT_TAKEN)
+            return;
+        uint8_t &counter = counters[index(pc)];
+        if (taken && counter < 3)
+            counter++;
+        else if (!taken && counter > 0)
+            counter--;
+        history = ((history << 1) | (taken ? 1 : 0)) & mask;
+    }
+
+    void save(StateWriter &out) const
+    {
+        out.put(kind);
+        out.put(history);
+        out.putVector(counters);
+    }
+
+    void restore(StateReader &in)
+    {
+        PredictorKind saved = in.get<PredictorKind>();
+        uint32_t saved_history = in.get<uint32_t>();
+        vector<uint8_t> saved_counters;
+        in.getVector(saved_counters);
+        if (saved != kind || saved_counters.size() != counters.size())
+            throw runtime_error("Branch predictor differs from the checkpoint");
+        history = saved_history;
+        counters = move(saved_counters);
+    }
+
+private:
+    uint32_t mask;
+    uint32_t history = 0; // ผลของ branch ล่าสุดๆ (gshare)
+    vector<uint8_t> counters;
+
+    uint32_t index(uint32_t pc) const
+    {
+        return ((pc >> 2) ^ (kind == PRED_GSHARE ? history : 0)) & mask;
+    }
+};
+
+/*  Pipeline 5 ขั้น IF / ID / EX / MEM / WB แบบ in-order ทีละ 1 คำสั่ง
+    CPU ทำคำสั่งแบบ functional ก่อน แล้วส่งคำสั่งที่ทำเสร็จมาที่ retire เพื่อคำนวณว่าแต่ละขั้นเกิดที่ cycle ไหน
+    - forwarding เต็มรูปแบบ: ผลของ ALU ใช้ได้ใน EX ของคำสั่งถัดไปเลย, ผลของ load ใช้ได้หลัง MEM (load-use stall 1 cycle)
+      ค่าที่ store เขียน ($rt ของ sw/sh/sb/sc) ใช้ใน MEM จึง forward จาก MEM ของ load ได้ (lw แล้ว sw ค่าเดิมไม่ stall)
+    - branch ทุกแบบตัดสินใน ID (ใช้ค่าได้หลัง EX ของคำสั่งก่อนหน้า) หรือใน EX, jr/jalr อ่าน register ใน ID
+    - มี BTB สมมติ: target ของ branch/j/jal รู้ตั้งแต่ IF ทายถูกไม่เสีย cycle, ทายผิดเสีย 1 (ID) หรือ 2 (EX) cycle
+      jr/jalr ไม่มี return-address stack ต้องรอ ID เสีย 1 cycle เสมอ
+*/
+class Pipeline
+{
+public:
+    bool resolve_in_id = true;
+    BranchPredictor predictor;
+
+    uint64_t instructions = 0;
+    uint64_t stall_load_use = 0;   // รอผลของ lw
+    uint64_t stall_branch_data = 0; // branch/jr ใน ID รอ operand
+    uint64_t stall_control = 0;    // bubble จาก branch ทายผิด / jr
+    uint64_t branches = 0;
+    uint64_t mispredicts = 0;
+
+    explicit Pipeline(const BranchPredictor &branch_predictor = BranchPredictor(), bool resolve_branch_in_id = true)
+        : resolve_in_id(resolve_branch_in_id), predictor(branch_predictor)
+    {
+        for (int64_t &r : ready)
+            r = 0;
+    }
+
+    // คำสั่ง in ที่อยู่ที่ pc ทำเสร็จแล้ว และ PC ถัดไปคือ next_pc
+    void retire(const Instr &in, uint32_t pc, uint32_t next_pc)
+    {
+        uint8_t dst = 0, src[2] = {0, 0};
+        operands(in, dst, src);
+        bool branch = isBranch(in.op);
+        bool jump_register = in.op == OP_JR || in.op == OP_JALR;
+        bool id_consumer = (branch && resolve_in_id) || jump_register; // ต้องใช้ค่าของ register ตั้งแต่ ID
+
+        // IF: เข้าได้เมื่อคำสั่งก่อนหน้าขยับไป ID แล้ว และหลังจาก fetch ใหม่ (ถ้าทายผิด)
+        int64_t if_t = max(last_id, fetch_ready);
+        stall_control += (uint64_t)(if_t - last_id);
+
+        // ID: รอจน operand พร้อม (hazard detection หยุดคำสั่งไว้ที่ ID)
+        int64_t id_t = max(if_t + 1, last_id + 1);
+        int64_t need = id_t;
+        for (int k = 0; k < 2; k++)
+        {
+            uint8_t r = src[k];
+            if (r == 0)
+                continue;
+            // ใช้ค่าใน EX = ID + 1 ยกเว้นค่าที่ store เขียน (src[1]) ใช้ใน MEM = ID + 2 (forward MEM -> MEM)
+            int64_t use = id_consumer ? 0 : (isStore(in.op) && k == 1) ? 2 : 1;
+            need = max(need, ready[r] - use);
+        }
+        if (need > id_t)
+        {
+            (id_consumer ? stall_branch_data : stall_load_use) += (uint64_t)(need - id_t);
+            id_t = need;
+        }
+        int64_t ex_t = id_t + 1;
+        int64_t mem_t = ex_t + 1;
+        last_wb = mem_t + 1;
+        last_id = id_t;
+
+        // ผลลัพธ์ forward ได้ตั้งแต่ cycle ถัดจาก EX (ALU) หรือถัดจาก MEM (load)
+        if (dst != 0)
+            ready[dst] = (isLoad(in.op) ? mem_t : ex_t) + 1;
+
+        if (branch)
+        {
+            bool taken = next_pc != pc + 4;
+            bool predicted = predictor.predict(pc);
+            predictor.update(pc, taken);
+            branches++;
+            if (predicted != taken)
+            {
+                mispredicts++;
+                fetch_ready = (resolve_in_id ? id_t : ex_t) + 1;
+            }
+        }
+        else if (jump_register)
+        {
+            fetch_ready = id_t + 1;
+        }
+        instructions++;
+    }
+
+    uint64_t cycles() const { return instructions ? (uint64_t)last_wb + 1 : 0; }
+
+    void report(ostream &out) const
+    {
+        out << "Pipeline (branch resolved in " << (resolve_in_id ? "ID" : "EX") << ", "
+            << (predictor.kind == PRED_NOT_TAKEN ? "not-taken" : predictor.kind == PRED_BIMODAL ? "bimodal" : "gshare") << " predictor):\n";
+        out << "  Cycles = " << cycles() << ", instructions = " << instructions
+            << ", CPI = " << (instructions ? (double)cycles() / instructions : 0.0) << "\n";
+        out << "  Stalls: load-use = " << stall_load_use << ", branch operand = " << stall_branch_data
+            << ", control = " << stall_control << "\n";
+        out << "  Branches = " << branches << ", mispredicted = " << mispredicts << " ("
+            << (branches ? 100.0 * mispredicts / branches : 0.0) << "%)\n";
+    }
+
+private:
+    int64_t last_id = 0;     // cycle ที่คำสั่งก่อนหน้าอยู่ใน ID
+    int64_t last_wb = 0;
+    int64_t fetch_ready = 0; // cycle แรกที่ fetch ได้หลังเปลี่ยน PC
+    int64_t ready[33];       // cycle แรกที่ค่าของ register forward ได้ (ช่อง HILO = hi/lo)
+
+public:
+    static constexpr uint8_t HILO = 32; // hi กับ lo นับเป็น register เดียวกัน (mult/div เขียนพร้อมกันทั้งคู่)
+
+    /*  register ที่คำสั่งเขียน (dst) และอ่าน (src) dst = 0 คือไม่เขียน register (ใช้ร่วมกับ TraceWriter)
+        เขียน $zero ก็นับว่าไม่เขียน เพราะ CPU ไม่เก็บค่าอยู่แล้ว
+    */
+    static void operands(const Instr &in, uint8_t &dst, uint8_t src[2])
+    {
+        switch (in.op)
+        {
+        case OP_ADD:
+        case OP_SUB:
+        case OP_MUL:
+        case OP_AND:
+        case OP_OR:
+        case OP_SLT:
+        case OP_ADDU:
+        case OP_SUBU:
+        case OP_XOR:
+        case OP_NOR:
+        case OP_SLTU:
+        case OP_SLLV:
+        case OP_SRLV:
+        case OP_SRAV:
+        case OP_MOVZ:
+        case OP_MOVN:
+            dst = in.rd;
+            src[0] = in.rs;
+            src[1] = in.rt;
+            break;
+        case OP_SLL:
+        case OP_SRL:
+        case OP_SRA:
+            dst = in.rd;
+            src[0] = in.rt;
+            break;
+        case OP_CLZ:
+        case OP_CLO:
+            dst = in.rd;
+            src[0] = in.rs;
+            break;
+        case OP_LW:
+        case OP_LL:
+        case OP_LB:
+        case OP_LBU:
+        case OP_LH:
+        case OP_LHU:
+        case OP_ADDI:
+        case OP_ADDIU:
+        case OP_SLTI:
+        case OP_SLTIU:
+        case OP_ANDI:
+        case OP_ORI:
+        case OP_XORI:
+            dst = in.rt;
+            src[0] = in.rs;
+            break;
+        case OP_SC:
+            dst = in.rt;
+            src[0] = in.rs;
+            src[1] = in.rt;
+            break;
+        case OP_SW:
+        case OP_SB:
+        case OP_SH:
+        case OP_BEQ:
+        case OP_BNE:
+        case OP_TEQ:
+            src[0] = in.rs;
+            src[1] = in.rt;
+            break;
+        case OP_MULT:
+        case OP_MULTU:
+        case OP_DIV:
+        case OP_DIVU:
+        case OP_MADD: // madd/msub อ่าน hi/lo ด้วย แต่ผลของคำสั่งก่อนหน้า forward ทันเสมอ
+        case OP_MADDU:
+        case OP_MSUB:
+        case OP_MSUBU:
+            dst = HILO;
+            src[0] = in.rs;
+            src[1] = in.rt;
+            break;
+        case OP_MFHI:
+        case OP_MFLO:
+            dst = in.rd;
+            src[0] = HILO;
+            break;
+        case OP_MTHI:
+        case OP_MTLO:
+            dst = HILO;
+            src[0] = in.rs;
+            break;
+        case OP_LI:
+            dst = in.rt;
+            break;
+        case OP_JAL:
+            dst = 31;
+            break;
+        case OP_JR:
+        case OP_BLTZ:
+        case OP_BGEZ:
+        case OP_BLEZ:
+        case OP_BGTZ:
+            src[0] = in.rs;
+            break;
+        case OP_BLTZAL:
+        case OP_BGEZAL:
+            dst = 31;
+            src[0] = in.rs;
+            break;
+        case OP_JALR:
+            dst = in.rd;
+            src[0] = in.rs;
+            break;
+        default:
+            break;
+        }
+    }
+};
+
+//-----------------------------------------------Profiling-----------------------------------------------
+
+// ชื่อคำสั่งของ opcode (ใช้ตอนพิมพ์ report)
+inline const char *opcodeName(uint8_t op)
+{
+    switch (op)
+    {
+    case OP_ADD: return "add";
+    case OP_SUB: return "sub";
+    case OP_MUL: return "mul";
+    case OP_LW: return "lw";
+    case OP_SW: return "sw";
+    case OP_LI: return "li";
+    case OP_BEQ: return "beq";
+    case OP_BNE: return "bne";
+    case OP_J: return "j";
+    case OP_JAL: return "jal";
+    case OP_JR: return "jr";
+    case OP_AND: return "and";
+    case OP_OR: return "or";
+    case OP_SLT: return "slt";
+    case OP_LL: return "ll";
+    case OP_SC: return "sc";
+    case OP_ADDU: return "addu";
+    case OP_SUBU: return "subu";
+    case OP_XOR: return "xor";
+    case OP_NOR: return "nor";
+    case OP_SLTU: return "sltu";
+    case OP_SLL: return "sll";
+    case OP_SRL: return "srl";
+    case OP_SRA: return "sra";
+    case OP_SLLV: return "sllv";
+    case OP_SRLV: return "srlv";
+    case OP_SRAV: return "srav";
+    case OP_MULT: return "mult";
+    case OP_MULTU: return "multu";
+    case OP_DIV: return "div";
+    case OP_DIVU: return "divu";
+    case OP_MADD: return "madd";
+    case OP_MADDU: return "maddu";
+    case OP_MSUB: return "msub";
+    case OP_MSUBU: return "msubu";
+    case OP_MFHI: return "mfhi";
+    case OP_MFLO: return "mflo";
+    case OP_MTHI: return "mthi";
+    case OP_MTLO: return "mtlo";
+    case OP_MOVZ: return "movz";
+    case OP_MOVN: return "movn";
+    case OP_CLZ: return "clz";
+    case OP_CLO: return "clo";
+    case OP_ADDI: return "addi";
+    case OP_ADDIU: return "addiu";
+    case OP_SLTI: return "slti";
+    case OP_SLTIU: return "sltiu";
+    case OP_ANDI: return "andi";
+    case OP_ORI: return "ori";
+    case OP_XORI: return "xori";
+    case OP_LB: return "lb";
+    case OP_LBU: return "lbu";
+    case OP_LH: return "lh";
+    case OP_LHU: return "lhu";
+    case OP_SB: return "sb";
+    case OP_SH: return "sh";
+    case OP_BLTZ: return "bltz";
+    case OP_BGEZ: return "bgez";
+    case OP_BLEZ: return "blez";
+    case OP_BGTZ: return "bgtz";
+    case OP_BLTZAL: return "bltzal";
+    case OP_BGEZAL: return "bgezal";
+    case OP_JALR: return "jalr";
+    case OP_TEQ: return "teq";
+    default: return "invalid";
+    }
+}
+
+/*  ตัวนับของ --profile: จำนวนคำสั่งแยกตาม opcode, branch taken/not taken แยกตามคำสั่ง branch,
+    จำนวนครั้งที่ทำแต่ละ PC และ histogram ของ address ที่ load/store (นับเป็นช่วงละ 1 << HIST_SHIFT byte)
+    CPU เรียกผ่าน SIM_PROFILE_HOOK เท่านั้น ถ้า compile โดยไม่มี SIM_PROFILE จะนับได้แค่จำนวนคำสั่งรวมกับเวลา
+*/
+class Profile
+{
+public:
+    static constexpr uint32_t HIST_SHIFT = 6; // 64 byte ต่อช่อง (ขนาด cache line)
+
+    array<uint64_t, OP_COUNT> op_count = {};
+    array<uint64_t, OP_COUNT> taken = {}; // นับแยกตาม opcode ของ branch
+    array<uint64_t, OP_COUNT> not_taken = {};
+    vector<uint64_t> pc_count;      // pc_count[i] = จำนวนครั้งที่ทำคำสั่งที่ code_base + i * 4
+    uint32_t code_base = 0;
+    unordered_map<uint32_t, uint64_t> loads;  // (address >> HIST_SHIFT) -> จำนวนครั้ง
+    unordered_map<uint32_t, uint64_t> stores;
+    long long retired = 0;  // จำนวนคำสั่งรวม (engine บอกมา นับได้ทุก build)
+    double seconds = 0;     // เวลาที่ host ใช้รัน
+
+    // เตรียมตัวนับ per-PC ให้พอดีกับโปรแกรม
+    void attach(const Program &prog)
+    {
+        code_base = prog.text_base;
+        pc_count.assign(prog.code.size(), 0);
+    }
+
+    SIM_INLINE void instruction(uint32_t pc, uint8_t op)
+    {
+        op_count[op]++;
+        uint32_t index = (pc - code_base) / 4;
+        if (index < pc_count.size())
+            pc_count[index]++;
+    }
+    SIM_INLINE void branch(uint8_t op, bool was_taken)
+    {
+        (was_taken ? taken : not_taken)[op]++;
+    }
+    void load(uint32_t addr) { loads[addr >> HIST_SHIFT]++; }
+    void store(uint32_t addr) { stores[addr >> HIST_SHIFT]++; }
+
+    void report(ostream &out) const
+    {
+        out << "Profile:\n";
+        out << "  Retired instructions = " << retired << "\n";
+        out << "  Host time = " << seconds << " s";
+        if (seconds > 0)
+            out << " (" << retired / seconds / 1e6 << " MIPS)";
+        out << "\n";
+#if SIM_PROFILE
+        uint64_t total = 0;
+        for (uint64_t n : op_count)
+            total += n;
+        out << "  Opcode    Count          %\n";
+        for (size_t op = 0; op < OP_COUNT; op++)
+        {
+            if (op_count[op] == 0)
+                continue;
+            char line[80];
+            snprintf(line, sizeof(line), "  %-8s %12llu %7.2f%%\n", opcodeName((uint8_t)op),
+                     (unsigned long long)op_count[op], total ? 100.0 * op_count[op] / total : 0.0);
+            out << line;
+        }
+        for (size_t b = 0; b < OP_COUNT; b++)
+        {
+            if (taken[b] + not_taken[b] == 0)
+                continue;
+            out << "  " << opcodeName((uint8_t)b) << ": taken " << taken[b] << ", not taken " << not_taken[b] << " ("
+                << 100.0 * taken[b] / (taken[b] + not_taken[b]) << "% taken)\n";
+        }
+        histogram(out, "Loads", loads);
+        histogram(out, "Stores", stores);
+#else
+        out << "  (per-opcode / per-PC counters need a build with -DSIM_PROFILE=1)\n";
+#endif
+    }
+
+    /*  flat profile: PC ที่ทำบ่อยสุดก่อน พร้อมเลขบรรทัดและข้อความใน .asm (source = ทุกบรรทัดของไฟล์)
+        ไฟล์ binary ไม่มี source_line จะพิมพ์แค่ชื่อคำสั่ง
+    */
+    void writeFlatProfile(ostream &out, const Program &prog, const vector<string> &source) const
+    {
+        vector<uint32_t> order;
+        uint64_t total = 0;
+        for (uint32_t i = 0; i < pc_count.size(); i++)
+        {
+            if (pc_count[i] == 0)
+                continue;
+            order.push_back(i);
+            total += pc_count[i];
+        }
+        stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) { return pc_count[a] > pc_count[b]; });
+
+        out << "#     count       %   cum %  pc          line  source\n";
+        uint64_t cumulative = 0;
+        for (uint32_t i : order)
+        {
+            cumulative += pc_count[i];
+            int line_no = i < prog.source_line.size() ? prog.source_line[i] : 0;
+            string text = line_no > 0 && (size_t)line_no <= source.size() ? source[line_no - 1] : opcodeName(prog.code[i].op);
+            size_t first = text.find_first_not_of(" \t");
+            text = first == string::npos ? "" : text.substr(first);
+            char head[96];
+            snprintf(head, sizeof(head), "%11llu %7.2f %7.2f  0x%08x %5d  ", (unsigned long long)pc_count[i],
+                     100.0 * pc_count[i] / total, 100.0 * cumulative / total, code_base + i * 4, line_no);
+            out << head << text << "\n";
+        }
+    }
+
+private:
+    // พิมพ์ 10 ช่วง address ที่ถูกใช้บ่อยที่สุด
+    static void histogram(ostream &out, const char *name, const unordered_map<uint32_t, uint64_t> &counts)
+    {
+        if (counts.empty())
+            return;
+        vector<pair<uint32_t, uint64_t>> sorted(counts.begin(), counts.end());
+        sort(sorted.begin(), sorted.end(), [](const pair<uint32_t, uint64_t> &a, const pair<uint32_t, uint64_t> &b) {
+            return a.second != b.second ? a.second > b.second : a.first < b.first;
+        });
+        out << "  " << name << " by address (" << (1u << HIST_SHIFT) << " byte buckets, " << counts.size() << " buckets used):\n";
+        for (size_t i = 0; i < sorted.size() && i < 10; i++)
+        {
+            char line[64];
+            snprintf(line, sizeof(line), "    0x%08x %12llu\n", sorted[i].first << HIST_SHIFT, (unsigned long long)sorted[i].second);
+            out << line;
+        }
+    }
+};
+
+//-----------------------------------------------Execution trace-----------------------------------------------
+
+/*  ไฟล์ trace (--trace) เก็บทุกคำสั่งที่ทำ: PC, คำสั่ง, register ที่เขียน และ memory ที่อ่าน/เขียน
+    header 16 byte: "MIPSTRC" 0, uint32 version, uint32 ขนาด record
+    ตามด้วย chunk: uint32 จำนวน record, uint32 codec (0 = ไม่บีบอัด, 1 = LZ), uint32 ขนาดข้อมูล แล้วตามด้วยข้อมูล
+    record ใน chunk มีขนาดเท่ากันหมด เก็บ PC และ address แบบ delta (เริ่มนับใหม่ทุก chunk อ่านแยก chunk ได้)
+    คำสั่งที่ทำต่อกันไปตามปกติ pc_delta = 0 ข้อมูลส่วนใหญ่จึงเป็น 0 หรือซ้ำกัน บีบอัดได้ดี
+    ตัวเลขทุกตัวเป็น byte order ของ host (little endian บน x86 / ARM)
+*/
+static const char TRACE_MAGIC[8] = {'M', 'I', 'P', 'S', 'T', 'R', 'C', 0};
+static constexpr uint32_t TRACE_VERSION = 2; // 2: เพิ่มคำสั่ง MIPS32 (เลข opcode เปลี่ยน)
+
+enum TraceFlag : uint8_t
+{
+    TRACE_REG = 1,   // เขียน register reg = reg_value
+    TRACE_LOAD = 2,  // อ่าน memory ที่ address = mem_value
+    TRACE_STORE = 4, // เขียน memory
+};
+
+struct TraceRecord
+{
+    int32_t pc_delta;  // pc - (pc ของ record ก่อนหน้า + 4)
+    uint8_t op, rd, rs, rt;
+    int32_t imm;
+    uint8_t flags;     // TraceFlag
+    uint8_t reg;
+    uint8_t reserved[2];
+    int32_t reg_value;
+    int32_t mem_delta; // address - address ของ load/store ก่อนหน้า
+    uint32_t mem_value;
+};
+static_assert(sizeof(TraceRecord) == 28, "TraceRecord must stay packed");
+
+// บีบอัด / คืนข้อมูลของ chunk ใน trace (LZ แบบ LZ4 block ดู cpu.cpp)
+void lzCompress(const uint8_t *src, size_t size, vector<uint8_t> &out);
+void lzDecompress(const uint8_t *src, size_t src_size, uint8_t *dst, size_t size);
+
+/*  เขียน trace แบบไม่ให้ loop ของ CPU ต้องรอ disk: CPU เติม record ลง chunk ใน ring buffer
+    พอ chunk เต็มก็ส่งให้ thread เบื้องหลังบีบอัดแล้วเขียนลงไฟล์ CPU ไปเติม chunk ถัดไปต่อทันที
+    CPU จะรอเฉพาะตอนที่ทุก chunk ใน ring ยังเขียนไม่เสร็จ (disk / การบีบอัดช้ากว่าการจำลอง)
+*/
+class TraceWriter
+{
+public:
+    static constexpr size_t CHUNK_RECORDS = 1 << 16;
+    static constexpr size_t RING_CHUNKS = 8;
+
+    TraceWriter(const string &path, bool compress) : compress(compress), ring(RING_CHUNKS), counts(RING_CHUNKS, 0)
+    {
+        out.open(path, ios::binary);
+        if (!out)
+            throw runtime_error("Cannot write trace: " + path);
+        uint32_t header[2] = {TRACE_VERSION, (uint32_t)sizeof(TraceRecord)};
+        out.write(TRACE_MAGIC, sizeof(TRACE_MAGIC));
+        out.write((const char *)header, sizeof(header));
+        for (auto &chunk : ring)
+            chunk.reset(new TraceRecord[CHUNK_RECORDS]);
+        current = ring[0].get();
+        writer = thread(&TraceWriter::drain, this);
+    }
+
+    ~TraceWriter()
+    {
+        try
+        {
+            close();
+        }
+        catch (const exception &)
+        {
+        }
+    }
+
+    TraceWriter(const TraceWriter &) = delete;
+    TraceWriter &operator=(const TraceWriter &) = delete;
+
+    /*  บันทึกคำสั่ง in ที่อยู่ที่ pc (ทำเสร็จแล้ว) registers = ค่าหลังทำคำสั่ง
+        mem_addr / store_value คำนวณก่อนทำคำสั่ง (lw อาจเขียนทับ register ที่ใช้คิด address)
+    */
+    SIM_INLINE void retire(uint32_t pc, const Instr &in, const int *registers, uint32_t mem_addr, uint32_t store_value)
+    {
+        TraceRecord &r = current[count];
+        r.pc_delta = (int32_t)(pc - next_pc);
+        r.op = in.op;
+        r.rd = in.rd;
+        r.rs = in.rs;
+        r.rt = in.rt;
+        r.imm = in.imm;
+        r.flags = 0;
+        r.reserved[0] = r.reserved[1] = 0;
+        uint8_t dst = 0, src[2] = {0, 0};
+        Pipeline::operands(in, dst, src);
+        if (dst == Pipeline::HILO) // hi/lo ไม่ได้อยู่ใน registers ไม่บันทึก
+            dst = 0;
+        r.reg = dst;
+        r.reg_value = dst ? registers[dst] : 0;
+        if (dst)
+            r.flags |= TRACE_REG;
+        r.mem_delta = 0;
+        r.mem_value = 0;
+        // sc ที่ไม่สำเร็จ ($rt = 0 หลังทำ) ไม่ได้เขียน memory จึงไม่มี record ของ store (sc $zero ดูผลไม่ได้ ถือว่าเขียน)
+        bool failed_sc = in.op == OP_SC && in.rt != 0 && registers[in.rt] == 0;
+        if ((isLoad(in.op) || isStore(in.op)) && !failed_sc)
+        {
+            bool store = isStore(in.op);
+            r.flags |= store ? TRACE_STORE : TRACE_LOAD;
+            r.mem_delta = (int32_t)(mem_addr - last_addr);
+            if (in.op == OP_SB)
+                store_value &= 0xFF;
+            else if (in.op == OP_SH)
+                store_value &= 0xFFFF;
+            r.mem_value = store ? store_value : (uint32_t)registers[in.rt];
+            last_addr = mem_addr;
+        }
+        next_pc = pc + 4;
+        total++;
+        if (++count == CHUNK_RECORDS)
+            submit();
+    }
+
+    // เขียน record ที่ค้างอยู่ทั้งหมดแล้วปิดไฟล์ (ถ้า thread เขียนไฟล์ error จะ throw ตรงนี้)
+    void close()
+    {
+        if (!writer.joinable())
+            return;
+        try
+        {
+            if (count > 0)
+                submit();
+        }
+        catch (const exception &) // error ถูกเก็บไว้ใน error แล้ว ต้อง join thread ก่อน throw
+        {
+        }
+        {
+            lock_guard<mutex> guard(lock);
+            closing = true;
+        }
+        has_data.notify_one();
+        writer.join();
+        out.close();
+        if (!error.empty())
+            throw runtime_error(error);
+    }
+
+    uint64_t records() const { return total; }
+    uint64_t bytesWritten() const { return written; }
+
+private:
+    bool compress;
+    ofstream out;
+    vector<unique_ptr<TraceRecord[]>> ring;
+    vector<size_t> counts;  // จำนวน record ในแต่ละ chunk ที่ส่งแล้ว
+    TraceRecord *current;   // chunk ที่ CPU กำลังเติม
+    size_t count = 0;
+    uint32_t next_pc = 0;   // สถานะของ delta (เริ่มใหม่ทุก chunk)
+    uint32_t last_addr = 0;
+    uint64_t total = 0;
+
+    // produced / consumed นับ chunk ที่ส่งแล้ว / เขียนเสร็จแล้ว chunk ที่ i อยู่ที่ ring[i % RING_CHUNKS]
+    mutex lock;
+    condition_variable has_data;
+    condition_variable has_space;
+    uint64_t produced = 0;
+    uint64_t consumed = 0;
+    bool closing = false;
+    string error;
+    atomic<uint64_t> written{sizeof(TRACE_MAGIC) + 8};
+    thread writer;
+
+    void submit()
+    {
+        unique_lock<mutex> guard(lock);
+        counts[produced % RING_CHUNKS] = count;
+        produced++;
+        has_data.notify_one();
+        has_space.wait(guard, [&] { return produced - consumed < RING_CHUNKS || !error.empty(); });
+        if (!error.empty())
+            throw runtime_error(error);
+        guard.unlock();
+        current = ring[produced % RING_CHUNKS].get();
+        count = 0;
+        next_pc = 0;
+        last_addr = 0;
+    }
+
+    void drain()
+    {
+        vector<uint8_t> packed;
+        while (true)
+        {
+            size_t slot, records;
+            {
+                unique_lock<mutex> guard(lock);
+                has_data.wait(guard, [&] { return consumed < produced || closing; });
+                if (consumed == produced)
+                    return;
+                slot = consumed % RING_CHUNKS;
+                records = counts[slot];
+            }
+            try
+            {
+                const uint8_t *raw = (const uint8_t *)ring[slot].get();
+                size_t raw_size = records * sizeof(TraceRecord);
+                uint32_t header[3] = {(uint32_t)records, 0, (uint32_t)raw_size};
+                if (compress)
+                {
+                    lzCompress(raw, raw_size, packed);
+                    if (packed.size() < raw_size)
+                    {
+                        header[1] = 1;
+                        header[2] = (uint32_t)packed.size();
+                        raw = packed.data();
+                    }
+                }
+                out.write((const char *)header, sizeof(header));
+                out.write((const char *)raw, header[2]);
+                if (!out)
+                    throw runtime_error("Write to trace file failed");
+                written += sizeof(header) + header[2];
+            }
+            catch (const exception &e)
+            {
+                lock_guard<mutex> guard(lock);
+                error = e.what();
+                has_space.notify_one();
+                return;
+            }
+            {
+                lock_guard<mutex> guard(lock);
+                consumed++;
+            }
+            has_space.notify_one();
+        }
+    }
+};
+
+extern const char *const REGISTER_NAMES[32];      // ชื่อ register ตาม index ($zero .. $ra)
+string formatInstr(const Instr &in);                // แปลงคำสั่งที่ถอดรหัสแล้วกลับเป็นข้อความแบบ assembly
+void readTrace(const string &path, ostream &out);   // แปลงไฟล์ trace เป็นข้อความ 1 บรรทัดต่อคำสั่ง
+
+class CPU // class cpu;
+{
+public:
+
+    int registers[32] = {0};                                        //  สร้าง 32 Registers และตั้งให้ทุกช่องใน Array มีค่าเป็น 0
+    int hi = 0, lo = 0;                                             //  ผลของ mult (64 bit: hi = 32 bit บน, lo = 32 bit ล่าง) / div (lo = ผลหาร, hi = เศษ)
+    int PC = 0;                                                     //  Program Counter บอกตำแหน่งปัจจุบันของ Command ที่ Process อยู่
+    Memory memory;                                                  //  Ram แบบ byte address 32 bit จองทีละ page 4KB เฉพาะส่วนที่ใช้จริง (ดู class Memory)
+    unordered_map<string, Opcode> instr_map;                        /*  สร้างตัวแปรชื่อ instr_map มาเก็บ command list
+                                                                        unordered_map = การสร้าง map ที่ไม่ได้เรียงตามตัวอักษรถ้าเรียงตามตัวอักษรอัตโนมัติจะใช้ map
+                                                                        unordered_map<string, Opcode> เป็น hash map จากชื่อคำสั่งไปเป็น Opcode
+                                                                        hash map = โครงสร้างข้อมูลที่มีรูปแบบเป็น คู่ key กับ value เช่น map["Alice"] = 30;
+                                                                        ใช้แค่ตอนถอดรหัส (decode) เท่านั้น ตอน execute ใช้ switch ตาม Opcode
+                                                                    */
+    unordered_map<string, int> reg_map;                             // สร้าง map ที่ไม่เรียงตามอักษร ไว้เก็บค่า value แต่ละ register
+
+
+    CPU()
+    {
+        registers[0] = 0;     // Register 0 มีค่าเป็น 0 เท่านั้น(ห้ามเปลี่ยน)
+        initInstructionMap(); // ประกาศ function ทิ้งไว้
+        initRegisterMap();    // ประกาศ function ทิ้งไว้
+    }
+
+
+    //  ค่า fix ไว้อยู่แล้ว(initRegisterMap ห้ามแก้!)
+    void initRegisterMap() // ทำให้ function initRegisterMap() กำหนดข้อมูลใน map register
+    {
+
+        reg_map["$zero"] = 0; //$Zero Register เป็น Constant มีค่า 0 (เปลี่ยนแปลงไม่ได้)
+        reg_map["$at"] = 1;   // "$Assembler Temporary ทำหน้าที่เก็บข้อมูลชั่วคราวระหว่างการแปลรหัส assembly หรือช่วยในการคำนวณที่ซับซ้อนระหว่างการแปลรหัส
+
+        // $Value เก็บค่า Result จากฟังก์ชันหรือการคำนวณ ใช้ใน system calls เพื่อบอก OS ว่าต้องการให้ทำอะไร ($v0 เก็บผลลัพธ์หลัก)($v1 เก็บผลลัพธ์รอง)
+        reg_map["$v0"] = 2;
+        reg_map["$v1"] = 3;
+        // $Arguments ข้อมูลที่ส่งให้กับฟังก์ชันเพื่อให้ฟังก์ชันนั้นสามารถทำงานได้
+        reg_map["$a0"] = 4;
+        reg_map["$a1"] = 5;
+        reg_map["$a2"] = 6;
+        reg_map["$a3"] = 7;
+        // $Temporary registers ชั่วคราว ที่ใช้ในการเก็บข้อมูลระหว่างการคำนวณหรือลำดับการดำเนินงานต่าง ๆ
+
+        reg_map["$t0"] = 8;
+        reg_map["$t1"] = 9;
+        reg_map["$t2"] = 10;
+        reg_map["$t3"] = 11;
+
+        reg_map["$t4"] = 12;
+        reg_map["$t5"] = 13;
+        reg_map["$t6"] = 14;
+        reg_map["$t7"] = 15;
+        // $Saved Registers ที่เก็บค่าไว้ระหว่างการเรียกฟังก์ชัน
+        reg_map["$s0"] = 16;
+        reg_map["$s1"] = 17;
+        reg_map["$s2"] = 18;
+        reg_map["$s3"] = 19;
+        reg_map["$s4"] = 20;
+        reg_map["$s5"] = 21;
+        reg_map["$s6"] = 22;
+        reg_map["$s7"] = 23;
+
+        // $Temporary registers ชั่วคราว ที่ใช้ในการเก็บข้อมูลระหว่างการคำนวณหรือลำดับการดำเนินงานต่าง ๆ
+        reg_map["$t8"] = 24;
+        reg_map["$t9"] = 25;
+
+        // Special Registers ตัวแปร พิเศษ
+        //$Kernel registers ใช้โดย OS ถูกสงวนไว้สำหรับการใช้งานของระบบปฏิบัติการ
+        reg_map["$k0"] = 26;
+        reg_map["$k1"] = 27;
+
+        reg_map["$gp"] = 28; // Global Pointer ชี้ไปยังตำแหน่งเริ่มต้นของ global data segment ซึ่งเป็นส่วนของหน่วยความจำที่เก็บข้อมูลที่สามารถเข้าถึงได้จากทั่วทั้งโปรแกรม
+        reg_map["$sp"] = 29; // Stack Pointer ชี้ไปยังตำแหน่งปัจจุบันของ stack ข้อมูลจะถูก push (บันทึก) หรือ pop (ดึงออก) ตามลำดับของ stack (LIFO
+        reg_map["$fp"] = 30; // Frame Pointer ชี้ไปยังตำแหน่งเริ่มต้นของ stack frame ของฟังก์ชันที่กำลังทำงาน
+        reg_map["$ra"] = 31; // Return Address ใช้เก็บ ที่อยู่ของคำสั่งถัดไป หลังจากที่เราเรียกฟังก์ชัน (หรือคำสั่ง) ใหม่
+    }
+
+    // จับคู่ ชื่อคำสั่ง (instruction) กับ Opcode การทำงานจริงของแต่ละคำสั่งอยู่ใน CPU::step
+    void initInstructionMap()
+    {
+        instr_map["add"] = OP_ADD;
+        instr_map["sub"] = OP_SUB;
+        instr_map["mul"] = OP_MUL;
+        instr_map["lw"] = OP_LW;
+        instr_map["sw"] = OP_SW;
+        instr_map["ll"] = OP_LL;
+        instr_map["sc"] = OP_SC;
+        instr_map["li"] = OP_LI;
+        instr_map["la"] = OP_LI; // la $t0, label = li ที่ใส่ address ของ label
+        instr_map["beq"] = OP_BEQ;
+        instr_map["bne"] = OP_BNE;
+        instr_map["j"] = OP_J;
+        instr_map["jal"] = OP_JAL;
+        instr_map["jr"] = OP_JR;
+        instr_map["and"] = OP_AND;
+        instr_map["or"] = OP_OR;
+        instr_map["slt"] = OP_SLT;
+        instr_map["addu"] = OP_ADDU;
+        instr_map["subu"] = OP_SUBU;
+        instr_map["xor"] = OP_XOR;
+        instr_map["nor"] = OP_NOR;
+        instr_map["sltu"] = OP_SLTU;
+        instr_map["sll"] = OP_SLL;
+        instr_map["srl"] = OP_SRL;
+        instr_map["sra"] = OP_SRA;
+        instr_map["sllv"] = OP_SLLV;
+        instr_map["srlv"] = OP_SRLV;
+        instr_map["srav"] = OP_SRAV;
+        instr_map["mult"] = OP_MULT;
+        instr_map["multu"] = OP_MULTU;
+        instr_map["div"] = OP_DIV;
+        instr_map["divu"] = OP_DIVU;
+        instr_map["madd"] = OP_MADD;
+        instr_map["maddu"] = OP_MADDU;
+        instr_map["msub"] = OP_MSUB;
+        instr_map["msubu"] = OP_MSUBU;
+        instr_map["mfhi"] = OP_MFHI;
+        instr_map["mflo"] = OP_MFLO;
+        instr_map["mthi"] = OP_MTHI;
+        instr_map["mtlo"] = OP_MTLO;
+        instr_map["movz"] = OP_MOVZ;
+        instr_map["movn"] = OP_MOVN;
+        instr_map["clz"] = OP_CLZ;
+        instr_map["clo"] = OP_CLO;
+        instr_map["addi"] = OP_ADDI;
+        instr_map["addiu"] = OP_ADDIU;
+        instr_map["slti"] = OP_SLTI;
+        instr_map["sltiu"] = OP_SLTIU;
+        instr_map["andi"] = OP_ANDI;
+        instr_map["ori"] = OP_ORI;
+        instr_map["xori"] = OP_XORI;
+        instr_map["lb"] = OP_LB;
+        instr_map["lbu"] = OP_LBU;
+        instr_map["lh"] = OP_LH;
+        instr_map["lhu"] = OP_LHU;
+        instr_map["sb"] = OP_SB;
+        instr_map["sh"] = OP_SH;
+        instr_map["bltz"] = OP_BLTZ;
+        instr_map["bgez"] = OP_BGEZ;
+        instr_map["blez"] = OP_BLEZ;
+        instr_map["bgtz"] = OP_BGTZ;
+        instr_map["bltzal"] = OP_BLTZAL;
+        instr_map["bgezal"] = OP_BGEZAL;
+        instr_map["jalr"] = OP_JALR;
+        instr_map["teq"] = OP_TEQ;
+        instr_map["lui"] = OP_LI; // lui $t0, imm = li $t0, imm << 16
+
+        // pseudo instruction ที่ assembler แปลงเป็นคำสั่งจริง (ดู CPU::decode)
+        instr_map["move"] = OP_ADDU; // move $rd, $rs = addu $rd, $rs, $zero
+        instr_map["nop"] = OP_SLL;   // sll $zero, $zero, 0
+        instr_map["b"] = OP_BEQ;     // b label = beq $zero, $zero, label
+        instr_map["beqz"] = OP_BEQ;  // beqz $rs, label = beq $rs, $zero, label
+        instr_map["bnez"] = OP_BNE;
+    }
+
+    int regIndex(const string &name, const string &instruction); // แปลงชื่อ register เป็น index ถ้าไม่มีจะ throw
+    int branchTarget(const string &token, const Program *prog, int index, bool relative); // แปลง target ของ branch/jump (ตัวเลขหรือ label)
+    int immediate(const string &token, const Program *prog);      // แปลงค่าคงที่ของ li/la (ตัวเลขหรือ address ของ label)
+    Instr decode(const string &instruction, const Program *prog = nullptr, int index = 0); // ถอดรหัสคำสั่ง 1 บรรทัด (string) เป็น Instr
+    vector<Instr> decodeProgram(const vector<string> &lines);     // ถอดรหัสทั้งโปรแกรมครั้งเดียวตอนโหลด
+    Program assemble(const vector<string> &lines);                // แปลงโปรแกรม assembly ทั้งไฟล์แบบ 2 pass (หา label ก่อนแล้วค่อยถอดรหัส)
+    Program loadProgram(const string &path);                      // อ่านไฟล์ .asm แล้ว assemble
+    Instr decodeWord(uint32_t word, uint32_t pc);                 // ถอดรหัส machine code 32 bit (R/I/J format) ของคำสั่งที่อยู่ที่ pc
+    Program loadBinary(const string &path, uint32_t base = 0, bool big_endian = true); // โหลดไฟล์ ELF32 หรือ flat binary (วางที่ base)
+    void load(const Program &prog, bool write_memory = true);     // ตั้ง PC = entry, ชี้ code ไปที่โปรแกรม และเขียน data segment ลง memory (prog ต้องอยู่จนรันเสร็จ)
+    void shareMemory(CPU &other) { memory.share(other.memory); }  // ใช้ memory เดียวกับ CPU อื่น (multi-core)
+    void reset();                                                 // ล้าง register, PC และ memory ให้เหมือน CPU ใหม่ (ใช้ CPU ตัวเดิมรันงานถัดไป)
+    SIM_INLINE void exec(uint8_t op, const Instr &in);            // ทำงานตาม op (ไม่เลื่อน PC) ใช้ร่วมกันทุก engine
+    SIM_INLINE void step(const Instr &in);                        // execute คำสั่งที่ถอดรหัสแล้ว 1 คำสั่ง
+    bool halted() const { return ((uint32_t)PC - code_base) / 4 >= code_count; } // PC ออกนอกโปรแกรมแล้ว
+    long long run(long long max_instructions = LLONG_MAX);        // วน fetch ตาม PC จนกว่า PC จะออกนอกโปรแกรมหรือครบจำนวนคำสั่ง คืนจำนวนคำสั่งที่ทำไป
+    long long runBlocks(long long max_instructions = LLONG_MAX);  // เหมือน run แต่ใช้ basic-block cache (threaded code) เร็วกว่าใน loop
+    long long runPipeline(Pipeline &pipe, long long max_instructions = LLONG_MAX); // เหมือน run แต่ส่งทุกคำสั่งให้ pipeline นับ cycle
+    long long runTrace(TraceWriter &trace, long long max_instructions = LLONG_MAX); // เหมือน run แต่บันทึกทุกคำสั่งลง trace
+    void writeCode(uint32_t addr);                                // sw เขียนทับ text: reloadCode แล้วจดลง code_writes (ถ้า record_code_writes)
+    void reloadCode(uint32_t addr);                               // word ใน text เปลี่ยน: ถอดรหัสใหม่จาก memory และลบ block ที่เกี่ยวข้อง
+    [[noreturn]] void trap(const char *what);                     // exception ของคำสั่ง (overflow / teq / คำสั่งที่ไม่รองรับ) ที่ PC - 4
+    int translate(uint32_t index);                                // แปลง basic block ที่เริ่มที่ code[index] เป็น threaded code คืน id ของ block
+
+    // โปรแกรมที่ load ไว้ (ชี้ไปที่ Program::code จนกว่าจะมีการเขียนทับ text แล้วค่อย copy มาเป็นของตัวเอง)
+    const Instr *code = nullptr;
+    uint32_t code_base = 0;
+    uint32_t code_count = 0;
+    uint32_t code_watch = 0;    // ขนาด text (byte) ที่ sw เขียนทับแล้วต้องถอดรหัสใหม่ 0 = ไม่ต้องเช็ค
+    vector<Instr> private_code;
+    bool record_code_writes = false; // จด address ที่เขียนทับ text ไว้ใน code_writes (MultiCore เปิดไว้)
+    vector<uint32_t> code_writes;    // address ใน text ที่ core นี้เขียนทับตั้งแต่ barrier ครั้งก่อน
+
+    // basic-block cache: block_of[index] = id ของ block ที่เริ่มที่ code[index] (-1 = ยังไม่แปล)
+    // block ยาวไม่เกิน MAX_BLOCK + 1 คำสั่ง block ที่ครอบ code[index] จึงเริ่มไม่เกิน MAX_BLOCK ช่องก่อนหน้าเสมอ
+    static constexpr uint32_t MAX_BLOCK = 64;
+    vector<int32_t> block_of;
+    vector<Block> blocks;
+    vector<int32_t> free_blocks; // id ของ block ที่ถูกเขียนทับแล้ว ใช้ซ้ำตอน translate
+
+    // สถานะของ ll/sc
+    uint32_t link_addr = 0;
+    uint32_t link_value = 0;
+    bool link_valid = false;
+
+    Profile *profile = nullptr;       // ถ้าไม่ใช่ nullptr และ compile ด้วย SIM_PROFILE=1 จะนับสถิติลง profile (CPU ไม่ได้เป็นเจ้าของ)
+    CacheHierarchy *caches = nullptr; // ถ้าไม่ใช่ nullptr ทุก fetch และ lw/sw จะผ่าน cache simulator (CPU ไม่ได้เป็นเจ้าของ)
+
+    void execute(string instruction); // สร้าง function เปล่าๆ มาเขียนแยกทีหลัง ทำงานโดยใช้ string
+    void printRegisters();            // สร้าง function เปล่าๆ มาเขียนแยกทีหลัง เป็น function void
+};
+
+int parseImm(const string &text); // แปลง string เป็นตัวเลข (ฐาน 10 หรือ 0x..)
+
+/*  เปิดไฟล์แบบ read-only แล้ว map ทั้งไฟล์เข้า memory (mmap) ไม่ต้อง copy ทั้งไฟล์ก่อนถอดรหัส
+    copy_on_write = true: เขียนลง data ได้ OS จะ copy เฉพาะ page ที่ถูกเขียน ไฟล์จริงไม่เปลี่ยน (ใช้กับ checkpoint)
+    บน Windows ไม่มี mmap เลยอ่านทั้งไฟล์ใส่ buffer แทน
+*/
+class MappedFile
+{
+public:
+    const uint8_t *data = nullptr;
+    size_t size = 0;
+
+    explicit MappedFile(const string &path, bool copy_on_write = false)
+    {
+#ifndef _WIN32
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            throw runtime_error("Cannot open file: " + path);
+        struct stat st;
+        if (fstat(fd, &st) == 0 && st.st_size > 0)
+        {
+            size = (size_t)st.st_size;
+            void *p = mmap(nullptr, size, copy_on_write ? PROT_READ | PROT_WRITE : PROT_READ, MAP_PRIVATE, fd, 0);
+            if (p != MAP_FAILED)
+            {
+                mapped = p;
+                data = (const uint8_t *)p;
+            }
+        }
+        close(fd);
+        if (data != nullptr || size == 0)
+            return;
+#endif
+        ifstream file(path, ios::binary);
+        if (!file)
+            throw runtime_error("Cannot open file: " + path);
+        buffer.assign(istreambuf_iterator<char>(file), istreambuf_iterator<char>());
+        data = (const uint8_t *)buffer.data();
+        size = buffer.size();
+    }
+
+    ~MappedFile()
+    {
+#ifndef _WIN32
+        if (mapped != nullptr)
+            munmap(mapped, size);
+#endif
+    }
+
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    uint8_t *writableData() { return (uint8_t *)data; } // ใช้ได้เฉพาะตอนเปิดแบบ copy_on_write
+
+private:
+    void *mapped = nullptr;
+    string buffer;
+};
+
+//-----------------------------------------------Checkpoint-----------------------------------------------
+
+/*  Checkpoint เก็บสถานะทั้งหมดของ CPU ลงไฟล์ แล้วกลับมารันต่อจากจุดนั้นได้ทันที (ข้ามช่วง initialize ของโปรแกรม)
+    ไฟล์: header 40 byte = "MIPSCKPT", uint32 version, uint32 ขนาด page, uint64 ขนาด state, uint64 จำนวน page, uint64 offset ของ page แรก
+    ตามด้วย state (ดู save) แล้วเว้นให้ page แรกเริ่มที่ offset หาร 4096 ลงตัว page เรียงตาม address ตามลำดับใน state
+    ตอน restore map ไฟล์ทั้งไฟล์แบบ copy-on-write แล้วให้ memory ใช้ page ในไฟล์ตรงๆ ไม่ต้องอ่านทั้งไฟล์
+    page ที่โปรแกรมเขียนหลัง restore เท่านั้นที่ OS จะ copy ให้
+    ไม่ได้เก็บโปรแกรม เก็บแค่ path และ hash ของคำสั่งไว้ ตอน restore จะโหลดโปรแกรมใหม่แล้วเช็คว่าเป็นโปรแกรมเดิม
+*/
+class Checkpoint
+{
+public:
+    static constexpr uint32_t VERSION = 2; // 2: เพิ่ม hi/lo
+
+    string program;         // path ของโปรแกรม
+    uint32_t base = 0;      // --base / --le ตอนโหลด flat binary
+    bool big_endian = true;
+    long long executed = 0; // จำนวนคำสั่งที่ทำไปแล้วก่อน checkpoint
+
+    // อ่าน header และ state จากไฟล์ (ยังไม่แตะ CPU)
+    explicit Checkpoint(const string &path) : file(make_shared<MappedFile>(path, true))
+    {
+        if (file->size < HEADER_SIZE || memcmp(file->data, MAGIC, sizeof(MAGIC)) != 0)
+            throw runtime_error("Not a checkpoint file: " + path);
+        StateReader header(file->data + sizeof(MAGIC), HEADER_SIZE - sizeof(MAGIC));
+        uint32_t version = header.get<uint32_t>();
+        uint32_t page_size = header.get<uint32_t>();
+        uint64_t state_size = header.get<uint64_t>();
+        page_count = header.get<uint64_t>();
+        pages_offset = header.get<uint64_t>();
+        if (version != VERSION || page_size != Memory::PAGE_SIZE)
+            throw runtime_error("Unsupported checkpoint version " + to_string(version));
+        if (state_size > file->size - HEADER_SIZE || pages_offset % Memory::PAGE_SIZE != 0 ||
+            pages_offset > file->size || page_count > (file->size - pages_offset) / Memory::PAGE_SIZE)
+            throw runtime_error("Truncated checkpoint: " + path);
+
+        StateReader state(file->data + HEADER_SIZE, (size_t)state_size);
+        program = state.getString();
+        base = state.get<uint32_t>();
+        big_endian = state.get<bool>();
+        executed = state.get<long long>();
+        code_hash = state.get<uint64_t>();
+        PC = state.get<int32_t>();
+        for (int &r : registers)
+            r = state.get<int32_t>();
+        hi = state.get<int32_t>();
+        lo = state.get<int32_t>();
+        link_addr = state.get<uint32_t>();
+        link_value = state.get<uint32_t>();
+        link_valid = state.get<bool>();
+        state.getVector(page_addrs);
+        if (page_addrs.size() != page_count)
+            throw runtime_error("Corrupt checkpoint");
+        if (state.get<bool>())
+            caches = readBlob(state);
+        if (state.get<bool>())
+            predictor = readBlob(state);
+    }
+
+    // เขียน checkpoint ของ cpu ที่รันโปรแกรม prog (โหลดจาก program) มาแล้ว executed คำสั่ง
+    static void save(const string &path, const CPU &cpu, const Program &prog, const string &program, uint32_t base, bool big_endian,
+                     long long executed, const CacheHierarchy *caches, const BranchPredictor *predictor)
+    {
+        vector<uint32_t> page_addrs;
+        cpu.memory.pages().forEachPage([&](uint32_t addr, const PageStore::Page &) { page_addrs.push_back(addr); });
+
+        StateWriter state;
+        state.putString(program);
+        state.put(base);
+        state.put(big_endian);
+        state.put(executed);
+        state.put(hashCode(prog));
+        state.put((int32_t)cpu.PC);
+        for (int r : cpu.registers)
+            state.put((int32_t)r);
+        state.put((int32_t)cpu.hi);
+        state.put((int32_t)cpu.lo);
+        state.put(cpu.link_addr);
+        state.put(cpu.link_value);
+        state.put(cpu.link_valid);
+        state.putVector(page_addrs);
+        state.put(caches != nullptr);
+        if (caches)
+        {
+            StateWriter blob;
+            caches->save(blob);
+            state.putVector(blob.bytes);
+        }
+        state.put(predictor != nullptr);
+        if (predictor)
+        {
+            StateWriter blob;
+            predictor->save(blob);
+            state.putVector(blob.bytes);
+        }
+
+        uint64_t pages_offset = (HEADER_SIZE + state.bytes.size() + Memory::PAGE_SIZE - 1) / Memory::PAGE_SIZE * Memory::PAGE_SIZE;
+        StateWriter header;
+        header.put(VERSION);
+        header.put(Memory::PAGE_SIZE);
+        header.put((uint64_t)state.bytes.size());
+        header.put((uint64_t)page_addrs.size());
+        header.put(pages_offset);
+
+        ofstream out(path, ios::binary);
+        if (!out)
+            throw runtime_error("Cannot write checkpoint: " + path);
+        out.write(MAGIC, sizeof(MAGIC));
+        out.write((const char *)header.bytes.data(), header.bytes.size());
+        out.write((const char *)state.bytes.data(), state.bytes.size());
+        vector<char> padding((size_t)pages_offset - HEADER_SIZE - state.bytes.size(), 0);
+        out.write(padding.data(), padding.size());
+        cpu.memory.pages().forEachPage([&](uint32_t, const PageStore::Page &page) {
+            out.write((const char *)page.bytes, sizeof(page.bytes));
+        });
+        if (!out)
+            throw runtime_error("Write to checkpoint failed: " + path);
+    }
+
+    /*  คืนสถานะให้ cpu ที่เพิ่ง load(prog, false) มา (memory ต้องยังว่าง)
+        caches / predictor คืนให้เฉพาะตัวที่มีทั้งใน checkpoint และในการรันครั้งนี้ ตัวที่ไม่มีใน checkpoint เริ่มจากว่าง
+    */
+    void restore(CPU &cpu, const Program &prog, CacheHierarchy *cache_sim, BranchPredictor *branch_predictor) const
+    {
+        if (hashCode(prog) != code_hash)
+            throw runtime_error("Program " + program + " has changed since the checkpoint was written");
+        uint8_t *pages = file->writableData() + pages_offset;
+        for (size_t i = 0; i < page_addrs.size(); i++)
+            cpu.memory.pages().borrow(page_addrs[i], (PageStore::Page *)(pages + i * Memory::PAGE_SIZE), file);
+
+        cpu.PC = PC;
+        copy(begin(registers), end(registers), cpu.registers);
+        cpu.hi = hi;
+        cpu.lo = lo;
+        cpu.link_addr = link_addr;
+        cpu.link_value = link_value;
+        cpu.link_valid = link_valid;
+        if (cache_sim && !caches.empty())
+        {
+            StateReader in(caches.data(), caches.size());
+            cache_sim->restore(in);
+        }
+        if (branch_predictor && !predictor.empty())
+        {
+            StateReader in(predictor.data(), predictor.size());
+            branch_predictor->restore(in);
+        }
+
+        // text ใน memory (ไฟล์ binary) อาจถูก sw เขียนทับไปแล้วก่อน checkpoint: ถอดรหัสคำสั่งที่ต่างจากโปรแกรมใหม่
+        if (prog.code_in_memory)
+        {
+            for (uint32_t i = 0; i < prog.code.size(); i++)
+            {
+                uint32_t addr = prog.text_base + i * 4;
+                Instr now = cpu.decodeWord(cpu.memory.read32(addr), addr);
+                const Instr &old = prog.code[i];
+                if (now.op != old.op || now.rd != old.rd || now.rs != old.rs || now.rt != old.rt || now.imm != old.imm)
+                    cpu.writeCode(addr);
+            }
+        }
+    }
+
+private:
+    static constexpr char MAGIC[8] = {'M', 'I', 'P', 'S', 'C', 'K', 'P', 'T'};
+    static constexpr size_t HEADER_SIZE = 40;
+
+    shared_ptr<MappedFile> file;
+    uint64_t page_count = 0;
+    uint64_t pages_offset = 0;
+    uint64_t code_hash = 0;
+    int32_t PC = 0;
+    int registers[32] = {0};
+    int32_t hi = 0, lo = 0;
+    uint32_t link_addr = 0;
+    uint32_t link_value = 0;
+    bool link_valid = false;
+    vector<uint32_t> page_addrs;
+    vector<uint8_t> caches;    // state ของ CacheHierarchy::save (ว่าง = ไม่มี)
+    vector<uint8_t> predictor; // state ของ BranchPredictor::save
+
+    static vector<uint8_t> readBlob(StateReader &in)
+    {
+        vector<uint8_t> blob;
+        in.getVector(blob);
+        return blob;
+    }
+
+    // FNV-1a ของคำสั่งทั้งโปรแกรม
+    static uint64_t hashCode(const Program &prog)
+    {
+        uint64_t hash = 14695981039346656037ull;
+        for (const Instr &in : prog.code)
+        {
+            uint8_t bytes[8] = {in.op, in.rd, in.rs, in.rt};
+            memcpy(bytes + 4, &in.imm, 4);
+            for (uint8_t b : bytes)
+                hash = (hash ^ b) * 1099511628211ull;
+        }
+        return hash;
+    }
+};
+
+/*  Barrier ให้ thread ของทุก core รอกันหลังจบแต่ละ quantum
+    แต่ละ core บอกว่ายังทำงานต่อไหม (active) ถ้าครบทุก core แล้วไม่มีใครทำต่อ ทุก thread จะได้ false กลับไป
+*/
+class QuantumBarrier
+{
+public:
+    explicit QuantumBarrier(size_t count) : count(count) {}
+
+    // on_last (ถ้ามี) ถูกเรียกโดย thread ที่มาถึงคนสุดท้าย ขณะที่ core อื่นยังรออยู่ทั้งหมด
+    bool wait(bool active, const function<void()> &on_last = nullptr)
+    {
+        unique_lock<mutex> guard(lock);
+        size_t gen = generation;
+        if (active)
+            active_count++;
+        if (++arrived == count)
+        {
+            if (on_last)
+                on_last();
+            keep_going = active_count > 0 && !stopped;
+            arrived = 0;
+            active_count = 0;
+            generation++;
+            cv.notify_all();
+        }
+        else
+            cv.wait(guard, [&] { return generation != gen; });
+        return keep_going;
+    }
+
+    // สั่งให้ทุก core หยุดที่ barrier ถัดไป (เช่น core ใด core หนึ่ง error)
+    void stop()
+    {
+        lock_guard<mutex> guard(lock);
+        stopped = true;
+    }
+
+private:
+    mutex lock;
+    condition_variable cv;
+    size_t count;
+    size_t arrived = 0;
+    size_t active_count = 0;
+    size_t generation = 0;
+    bool keep_going = true;
+    bool stopped = false;
+};
+
+/*  Multi-core: CPU หลายตัวใช้ memory ชุดเดียวกัน แต่ละ core รันบน host thread ของตัวเอง
+    ทุก core รันทีละ quantum คำสั่ง แล้วรอกันที่ barrier ก่อนเริ่ม quantum ถัดไป ไม่มี core ไหนนำหน้าเกิน 1 quantum
+    ภายใน quantum core รันพร้อมกันจริง ลำดับการเข้าถึง memory ระหว่าง core จึงไม่แน่นอน โปรแกรมต้องใช้ ll/sc ทำ lock เอง
+    (sc เทียบค่าแทน reservation จึงมีปัญหา ABA และ sw ธรรมดาปนกับ sc ได้ ดู OP_LL ใน CPU::exec)
+    แต่ละ core ถอดรหัส text ของตัวเอง ถ้า core ไหนเขียนทับ text (ไฟล์ binary) core อื่นจะถอดรหัสใหม่ที่ barrier
+    คือเห็นคำสั่งใหม่ตั้งแต่ quantum ถัดไป (เหมือน I-cache ของ core อื่นที่ต้อง sync ก่อนถึงจะเห็นโค้ดใหม่)
+    ตอนเริ่ม $a0 = เลข core, $a1 = จำนวน core และแต่ละ core มี stack แยกกัน core ละ 1MB
+*/
+class MultiCore
+{
+public:
+    static constexpr uint32_t STACK_SIZE = 0x100000;
+
+    vector<unique_ptr<CPU>> cores;
+    vector<long long> executed;
+    int fault_core = -1; // core ที่ error (-1 = ไม่มี)
+
+    explicit MultiCore(size_t count)
+    {
+        if (count == 0)
+            throw runtime_error("Core count must be at least 1");
+        for (size_t i = 0; i < count; i++)
+        {
+            cores.emplace_back(new CPU());
+            if (i > 0)
+                cores[i]->shareMemory(*cores[0]);
+        }
+        executed.assign(count, 0);
+    }
+
+    // prog ต้องอยู่จนรันเสร็จ เขียน data segment ลง memory ครั้งเดียวผ่าน core 0
+    void load(const Program &prog)
+    {
+        for (size_t i = 0; i < cores.size(); i++)
+        {
+            CPU &cpu = *cores[i];
+            cpu.load(prog, i == 0);
+            cpu.record_code_writes = cores.size() > 1;
+            cpu.registers[4] = (int)i;                        // $a0
+            cpu.registers[5] = (int)cores.size();             // $a1
+            cpu.registers[29] -= (int)(i * STACK_SIZE);       // $sp
+        }
+    }
+
+    // รันจนทุก core halt หรือแต่ละ core ครบ max_per_core คำสั่ง คืนจำนวนคำสั่งรวมทุก core
+    long long run(long long max_per_core, long long quantum, bool use_blocks)
+    {
+        if (quantum <= 0)
+            throw runtime_error("Quantum must be positive");
+        QuantumBarrier barrier(cores.size());
+        vector<exception_ptr> errors(cores.size());
+
+        auto worker = [&](size_t id) {
+            CPU &cpu = *cores[id];
+            long long &done = executed[id];
+            bool active = true;
+            while (true)
+            {
+                if (active)
+                {
+                    try
+                    {
+                        long long budget = min(quantum, max_per_core - done);
+                        done += use_blocks ? cpu.runBlocks(budget) : cpu.run(budget);
+                    }
+                    catch (...)
+                    {
+                        errors[id] = current_exception();
+                        barrier.stop();
+                    }
+                    active = !errors[id] && !cpu.halted() && done < max_per_core;
+                }
+                if (!barrier.wait(active, [&] { syncCode(); }))
+                    break;
+            }
+        };
+
+        vector<thread> threads;
+        for (size_t i = 1; i < cores.size(); i++)
+            threads.emplace_back(worker, i);
+        worker(0); // core 0 ใช้ thread ปัจจุบัน
+        for (thread &t : threads)
+            t.join();
+
+        for (size_t i = 0; i < cores.size(); i++)
+        {
+            if (errors[i])
+            {
+                fault_core = (int)i;
+                rethrow_exception(errors[i]);
+            }
+        }
+        long long total = 0;
+        for (long long n : executed)
+            total += n;
+        return total;
+    }
+
+private:
+    // ส่ง text ที่แต่ละ core เขียนทับให้ core อื่นถอดรหัสใหม่ (เรียกตอนทุก core หยุดรอที่ barrier)
+    void syncCode()
+    {
+        for (size_t i = 0; i < cores.size(); i++)
+        {
+            for (uint32_t addr : cores[i]->code_writes)
+            {
+                for (size_t j = 0; j < cores.size(); j++)
+                {
+                    if (j != i)
+                        cores[j]->reloadCode(addr);
+                }
+            }
+            cores[i]->code_writes.clear();
+        }
+    }
+};
+
+//-----------------------------------------------Lockstep (SIMD) engine-----------------------------------------------
+
+/*  รันโปรแกรมเดียวกันพร้อมกัน K ชุด (lane) ที่ค่าเริ่มต้นต่างกัน เช่น sweep input ทีละหลายพันแบบ
+    register ของทุก lane เก็บแบบ structure-of-arrays: reg[r][lane] ทุก lane ของ register เดียวกันอยู่ติดกัน
+    คำสั่งที่ถอดรหัสแล้ว 1 คำสั่งทำกับทุก lane ที่ active ด้วย SIMD (AVX-512 / AVX2 ตามที่ compile ได้ เช่น cmake -DSIM_NATIVE=ON ไม่งั้นทีละ lane)
+    ส่วน load/store, mult/div และคำสั่งที่ใช้ไม่บ่อยทำทีละ lane (แต่ละ lane มี memory ของตัวเอง)
+
+    branch ที่แต่ละ lane ไปคนละทาง: แยก lane ที่กระโดดกับไม่กระโดดเป็น 2 กลุ่มลง stack แล้วทำทีละกลุ่ม
+    จนถึง immediate post-dominator ของ branch (จุดแรกที่ทุกทางต้องผ่าน คิดจาก control-flow graph ตอน load) แล้วรวมกลับ
+    jal/jalr ดัน entry ที่รวมกลับที่ return address, jr ที่แต่ละ lane ไปคนละ address แยกกลุ่มตาม address
+    ทุก lane ทำคำสั่งของตัวเองตามลำดับเหมือนรันเดี่ยวเสมอ (ผลและจำนวนคำสั่งเท่ากับ CPU::run) stack มีผลแค่ว่ารวม lane ได้มากแค่ไหน
+
+    ไม่รองรับ cache / pipeline / profile / trace และ store ที่เขียนทับ text (lane นั้นจะ error)
+*/
+class LockstepCPU
+{
+public:
+    static constexpr uint32_t NO_PC = 0xFFFFFFFFu; // ไม่มีจุดรวม (รันจนทุก lane จบ)
+
+    const uint32_t lanes;           // จำนวน lane
+    const uint32_t stride;          // lanes ปัดขึ้นให้หารความกว้าง SIMD ลงตัว (lane ส่วนเกินไม่ได้ใช้)
+    vector<int32_t> regs;           // regs[r * stride + lane]
+    vector<int32_t> hi, lo;
+    vector<Memory> memory;          // memory ของแต่ละ lane (สร้างใหม่ตอน load)
+    vector<uint32_t> pc;            // PC ของแต่ละ lane (อัปเดตตอน lane จบ / หยุด)
+    vector<long long> executed;     // จำนวนคำสั่งที่แต่ละ lane ทำ
+    vector<string> fault;           // error ของ lane (ว่าง = ไม่มี) ตั้งก่อน run ได้เพื่อข้าม lane นั้น
+
+    uint64_t issued = 0;            // จำนวนครั้งที่ทำคำสั่ง (1 ครั้งทำได้หลาย lane)
+    uint64_t divergences = 0;       // จำนวนครั้งที่ branch / jr แยก lane ออกเป็นหลายกลุ่ม
+
+    explicit LockstepCPU(uint32_t lane_count);
+
+    int32_t &reg(uint32_t lane, int r) { return regs[(size_t)r * stride + lane]; }
+    bool halted(uint32_t lane) const { return (pc[lane] - code_base) / 4 >= code_count; }
+
+    void load(const Program &prog);   // ทุก lane: PC = entry, $gp/$sp และ data segment เหมือน CPU::load (prog ต้องอยู่จนรันเสร็จ)
+    long long run(long long max_instructions = LLONG_MAX); // ทุก lane ใช้ limit เดียวกัน
+    long long run(const vector<long long> &max_instructions); // limit ของแต่ละ lane คืนจำนวนคำสั่งรวมทุก lane
+
+    static const char *simdName();    // ชุดคำสั่ง SIMD ที่ compile เข้ามา ("avx512", "avx2", "scalar")
+
+private:
+    // entry ของ stack: กลุ่ม lane (mask = -1 ถ้า active) ที่อยู่ที่ pc เดียวกัน ทำจนถึง reconverge แล้ว pop
+    struct Group
+    {
+        uint32_t pc = 0;
+        uint32_t reconverge = NO_PC;
+        vector<int32_t> mask;
+        uint32_t active = 0;        // จำนวน lane ใน mask
+        long long steps = 0;        // จำนวนคำสั่งที่ทำไปแล้วแต่ยังไม่ได้บวกเข้า executed
+        long long budget = 0;       // steps ที่ทำได้ก่อนมี lane ครบ limit (0 = ต้องคิดใหม่)
+        bool inherit = false;       // กลุ่มของ call: ตอน pop คืน steps / budget ให้กลุ่มที่เรียก (mask เดียวกัน)
+    };
+
+    const Instr *code = nullptr;
+    uint32_t code_base = 0;
+    uint32_t code_count = 0;
+    uint32_t code_limit = 0;        // ขนาด text ใน memory (byte) ที่ห้าม store 0 = .asm
+    vector<uint32_t> reconverge_at; // PC ที่ branch ที่ code[i] รวมกลับ (NO_PC = ออกจาก function / โปรแกรม)
+    vector<Group> stack;
+    vector<long long> limit;
+    vector<uint32_t> link_addr, link_value;
+    vector<uint8_t> link_valid;
+
+    vector<int32_t> scratch;        // mask ชั่วคราวของ step (ขนาด stride)
+
+    void postDominators();
+    void flush(Group &group);
+    void remove(uint32_t lane, uint32_t at_pc, const string &error);
+    void split(const vector<int32_t> &target, const vector<int32_t> &mask, uint32_t reconverge);
+    void call(Group &group, uint32_t target);
+    void step(Group &group, const Instr &in);
+    void laneOp(Group &group, const Instr &in, uint32_t at);
+};
+
+#endif // SIM_CPU_H
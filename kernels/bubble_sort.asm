@@ -0,0 +1,61 @@
+# bubble sort 128 word จากน้อยไปมาก ข้อมูลเริ่มต้น x[i+1] = (13 * x[i] + 7) & 1023, x[0] = 1
+# ผล: array ที่ label array เรียงแล้ว, $v0 = 1 ถ้าเรียงถูก, $v1 = ผลรวมของ array
+.data
+array: .space 512
+.text
+    li $s7, 128
+    li $t8, 1
+    li $t9, 4
+    # สร้างข้อมูล
+    la $s0, array
+    li $t1, 1           # x
+    li $t2, 13
+    li $t3, 7
+    li $t4, 1023
+    li $t0, 0
+gen:
+    sw $t1, 0($s0)
+    mul $t1, $t1, $t2
+    add $t1, $t1, $t3
+    and $t1, $t1, $t4
+    add $s0, $s0, $t9
+    add $t0, $t0, $t8
+    bne $t0, $s7, gen
+
+    # sort: ทำ n - 1 รอบ แต่ละรอบสลับคู่ที่ติดกันที่ผิดลำดับ
+    sub $s6, $s7, $t8   # n - 1
+    li $t0, 0           # รอบ
+outer:
+    la $s0, array
+    sub $s5, $s6, $t0   # จำนวนคู่ที่ต้องเทียบในรอบนี้
+    li $t1, 0
+inner:
+    lw $t2, 0($s0)
+    lw $t3, 4($s0)
+    slt $t4, $t3, $t2
+    beq $t4, $zero, no_swap
+    sw $t3, 0($s0)
+    sw $t2, 4($s0)
+no_swap:
+    add $s0, $s0, $t9
+    add $t1, $t1, $t8
+    bne $t1, $s5, inner
+    add $t0, $t0, $t8
+    bne $t0, $s6, outer
+
+    # เช็คว่าเรียงแล้ว และรวมค่า
+    la $s0, array
+    li $v0, 1
+    lw $v1, 0($s0)
+    li $t1, 1
+check:
+    lw $t2, 0($s0)
+    lw $t3, 4($s0)
+    add $v1, $v1, $t3
+    slt $t4, $t3, $t2
+    beq $t4, $zero, ordered
+    li $v0, 0
+ordered:
+    add $s0, $s0, $t9
+    add $t1, $t1, $t8
+    bne $t1, $s7, check
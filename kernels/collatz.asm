@@ -0,0 +1,36 @@
+# collatz(n) นับจำนวนรอบจน n = 1 และค่าสูงสุดระหว่างทาง (ทางคู่/คี่ต่างกันตาม n ใช้ทดสอบ lockstep engine ที่แต่ละ lane ใส่ $a0 ไม่เท่ากัน)
+# $a0 = n (0 = ใช้ 27) ผล: $v0 = จำนวนรอบ, $v1 = ค่าสูงสุด (27: 111 รอบ, สูงสุด 9232)
+.text
+    j main
+
+# next(n) = n / 2 ถ้า n คู่, 3n + 1 ถ้า n คี่ ผลใน $v0
+next:
+    andi $t0, $a0, 1
+    bne $t0, $zero, odd
+    srl $v0, $a0, 1
+    jr $ra
+odd:
+    sll $t1, $a0, 1
+    addu $v0, $t1, $a0
+    addiu $v0, $v0, 1
+    jr $ra
+
+main:
+    bne $a0, $zero, start
+    li $a0, 27
+start:
+    li $s0, 0
+    move $s1, $a0
+loop:
+    li $t0, 1
+    beq $a0, $t0, done
+    jal next
+    move $a0, $v0
+    addiu $s0, $s0, 1
+    slt $t1, $s1, $a0
+    beq $t1, $zero, loop
+    move $s1, $a0
+    j loop
+done:
+    move $v0, $s0
+    move $v1, $s1
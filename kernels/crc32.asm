@@ -0,0 +1,49 @@
+# CRC-32 (polynomial 0xEDB88320 ทีละบิต) ของ buffer 1024 byte ที่สร้างขึ้นเอง buffer[i] = (i * 7 + 3) & 0xFF
+# เขียนแบบเดียวกับที่ compiler สร้าง: addiu / andi / sll / lbu / sb / srl / xor / nor / sltu / bgtz / divu
+# ผล: $v0 = crc32 (เก็บที่ result ด้วย), $v1 = crc32 % 65521 แบบ unsigned, $a0 = buffer[1023] อ่านด้วย lb (sign-extend)
+.data
+buffer: .space 1024
+result: .space 4
+.text
+    la $s0, buffer
+    li $s1, 1024
+    move $t0, $zero         # i
+fill:
+    sll $t1, $t0, 3
+    subu $t1, $t1, $t0      # i * 7
+    addiu $t1, $t1, 3
+    andi $t1, $t1, 0xFF
+    addu $t2, $s0, $t0
+    sb $t1, 0($t2)
+    addiu $t0, $t0, 1
+    sltu $t3, $t0, $s1
+    bne $t3, $zero, fill
+
+    lui $s2, 0xEDB8
+    ori $s2, $s2, 0x8320    # polynomial
+    nor $t0, $zero, $zero   # crc = 0xFFFFFFFF
+    move $t1, $zero         # i
+byte_loop:
+    addu $t2, $s0, $t1
+    lbu $t3, 0($t2)
+    xor $t0, $t0, $t3
+    li $t4, 8
+bit_loop:
+    andi $t5, $t0, 1
+    subu $t5, $zero, $t5    # mask = -(crc & 1)
+    and $t5, $t5, $s2
+    srl $t0, $t0, 1
+    xor $t0, $t0, $t5
+    addiu $t4, $t4, -1
+    bgtz $t4, bit_loop
+    addiu $t1, $t1, 1
+    sltu $t3, $t1, $s1
+    bne $t3, $zero, byte_loop
+
+    nor $v0, $t0, $zero     # crc ^ 0xFFFFFFFF
+    li $t6, 65521
+    divu $v0, $t6
+    mfhi $v1
+    la $t7, result
+    sw $v0, 0($t7)
+    lb $a0, 1023($s0)
@@ -0,0 +1,35 @@
+# fib(n) แบบ recursive เรียกด้วย jal / jr และเก็บ $ra, $a0, $s0 ไว้ใน stack
+# ผล: $v0 = fib(20) = 6765
+.text
+    li $a0, 20
+    jal fib
+    j exit
+
+# fib(n) = n ถ้า n < 2, ไม่งั้น fib(n - 1) + fib(n - 2)
+fib:
+    li $t0, 2
+    slt $t1, $a0, $t0
+    beq $t1, $zero, recurse
+    add $v0, $a0, $zero
+    jr $ra
+recurse:
+    li $t0, -12
+    add $sp, $sp, $t0
+    sw $ra, 8($sp)
+    sw $a0, 4($sp)
+    sw $s0, 0($sp)
+    li $t0, -1
+    add $a0, $a0, $t0
+    jal fib
+    add $s0, $v0, $zero  # fib(n - 1)
+    lw $a0, 4($sp)
+    li $t0, -2
+    add $a0, $a0, $t0
+    jal fib
+    add $v0, $v0, $s0
+    lw $s0, 0($sp)
+    lw $ra, 8($sp)
+    li $t0, 12
+    add $sp, $sp, $t0
+    jr $ra
+exit:
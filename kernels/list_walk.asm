@@ -0,0 +1,46 @@
+# linked list 1024 node (node = value, next) วางสลับที่กันใน memory: node ลำดับที่ k อยู่ช่อง (37k) & 1023
+# เดินทั้ง list 8 รอบ ผล: $v0 = ผลรวม value (0 + 1 + ... + 1023) * 8, $v1 = จำนวน node ที่เดินผ่าน
+.data
+nodes: .space 8192
+.text
+    li $s7, 1024
+    li $t8, 1
+    li $t7, 8
+    li $t6, 37
+    li $t5, 1023
+    la $s0, nodes
+    # สร้าง list: node[cur].value = k, node[cur].next = &node[nxt] (node สุดท้าย next = 0)
+    li $t0, 0           # k
+build:
+    mul $t1, $t0, $t6
+    and $t1, $t1, $t5   # cur
+    add $t2, $t0, $t8
+    mul $t2, $t2, $t6
+    and $t2, $t2, $t5   # nxt
+    mul $t1, $t1, $t7
+    add $t1, $t1, $s0   # &node[cur]
+    mul $t2, $t2, $t7
+    add $t2, $t2, $s0   # &node[nxt]
+    sw $t0, 0($t1)
+    add $t3, $t0, $t8
+    bne $t3, $s7, link
+    li $t2, 0
+link:
+    sw $t2, 4($t1)
+    add $t0, $t0, $t8
+    bne $t0, $s7, build
+
+    # เดิน list 8 รอบ
+    li $v0, 0
+    li $v1, 0
+    li $t4, 0           # รอบ
+walk_again:
+    add $t1, $s0, $zero # node แรกอยู่ช่อง 0
+walk:
+    lw $t2, 0($t1)
+    add $v0, $v0, $t2
+    add $v1, $v1, $t8
+    lw $t1, 4($t1)
+    bne $t1, $zero, walk
+    add $t4, $t4, $t8
+    bne $t4, $t7, walk_again
@@ -0,0 +1,60 @@
+# คูณ matrix 16x16: C = A * B โดย A[i][j] = i + j, B[i][j] = i - j
+# ผล: C อยู่ที่ label C, $v0 = ผลรวมทุกช่องของ C
+.data
+A: .space 1024
+B: .space 1024
+C: .space 1024
+.text
+    li $s7, 16          # N
+    li $t8, 1
+    li $t9, 4
+    # เติม A และ B
+    la $s0, A
+    la $s1, B
+    li $t0, 0           # i
+init_i:
+    li $t1, 0           # j
+init_j:
+    add $t2, $t0, $t1
+    sw $t2, 0($s0)
+    sub $t2, $t0, $t1
+    sw $t2, 0($s1)
+    add $s0, $s0, $t9
+    add $s1, $s1, $t9
+    add $t1, $t1, $t8
+    bne $t1, $s7, init_j
+    add $t0, $t0, $t8
+    bne $t0, $s7, init_i
+
+    # C[i][j] = sum_k A[i][k] * B[k][j]
+    li $s6, 64          # ขนาด 1 แถว (byte)
+    la $s2, C
+    li $v0, 0
+    li $t0, 0           # i
+row:
+    li $t1, 0           # j
+col:
+    la $s0, A
+    mul $t3, $t0, $s6
+    add $s0, $s0, $t3   # &A[i][0]
+    la $s1, B
+    mul $t3, $t1, $t9
+    add $s1, $s1, $t3   # &B[0][j]
+    li $t4, 0           # sum
+    li $t2, 0           # k
+dot:
+    lw $t5, 0($s0)
+    lw $t6, 0($s1)
+    mul $t7, $t5, $t6
+    add $t4, $t4, $t7
+    add $s0, $s0, $t9
+    add $s1, $s1, $s6
+    add $t2, $t2, $t8
+    bne $t2, $s7, dot
+    sw $t4, 0($s2)
+    add $v0, $v0, $t4
+    add $s2, $s2, $t9
+    add $t1, $t1, $t8
+    bne $t1, $s7, col
+    add $t0, $t0, $t8
+    bne $t0, $s7, row
@@ -0,0 +1,43 @@
+# copy 4096 word จาก src ไป dst (src[i] = 3i + 1) แล้วรวมค่าใน dst
+# ผล: $v0 = ผลรวมของ dst
+.data
+src: .space 16384
+dst: .space 16384
+.text
+    li $s7, 4096
+    li $t8, 1
+    li $t9, 4
+    li $t7, 3
+    # เติม src
+    la $s0, src
+    li $t0, 0
+fill:
+    mul $t1, $t0, $t7
+    add $t1, $t1, $t8
+    sw $t1, 0($s0)
+    add $s0, $s0, $t9
+    add $t0, $t0, $t8
+    bne $t0, $s7, fill
+
+    # copy
+    la $s0, src
+    la $s1, dst
+    li $t0, 0
+copy:
+    lw $t1, 0($s0)
+    sw $t1, 0($s1)
+    add $s0, $s0, $t9
+    add $s1, $s1, $t9
+    add $t0, $t0, $t8
+    bne $t0, $s7, copy
+
+    # รวมค่าใน dst
+    la $s1, dst
+    li $v0, 0
+    li $t0, 0
+sum:
+    lw $t1, 0($s1)
+    add $v0, $v0, $t1
+    add $s1, $s1, $t9
+    add $t0, $t0, $t8
+    bne $t0, $s7, sum
@@ -1,352 +1,1122 @@
-#include <iostream>
-#include <unordered_map>
-#include <sstream>
-#include <functional>
-#include <algorithm>
+#include "cpu.h"
 
-using namespace std;
+#include <chrono>
+#include <deque>
 
-class CPU // class cpu;
+/*  Thread pool แบบ work stealing สำหรับงานที่อ้างด้วย index 0..count-1
+    ตอนเริ่มแบ่ง index เป็นช่วงต่อกันให้แต่ละ worker เข้าคิวของตัวเอง
+    worker หยิบงานจากท้ายคิวตัวเอง ถ้าคิวตัวเองหมดจะไปขโมยจากหัวคิวของ worker อื่น งานที่ใช้เวลาไม่เท่ากันจึงกระจายได้เอง
+*/
+class WorkStealingPool
 {
 public:
+    explicit WorkStealingPool(size_t threads) : queues(max<size_t>(threads, 1)) {}
 
-    int registers[32] = {0};                                        //  สร้าง 32 Registers และตั้งให้ทุกช่องใน Array มีค่าเป็น 0
-    int PC = 0;                                                     //  Program Counter บอกตำแหน่งปัจจุบันของ Command ที่ Process อยู่
-    int memory[1024] = {0};                                         //  สร้าง Ram ขนาด 4KB โดยที่ 1 ช่อง array = 4 byte , 4*1024 = 4096B , = 4KB
-    unordered_map<string, function<void(int, int, int)>> instr_map; /*  สร้างตัวแปรชื่อ instr_map มาเก็บ command list
-                                                                        unordered_map = การสร้าง map ที่ไม่ได้เรียงตามตัวอักษรถ้าเรียงตามตัวอักษรอัตโนมัติจะใช้ map
-                                                                        unordered_map<string, function<void(int, int, int)>> เป็น hash map
-                                                                        hash map = โครงสร้างข้อมูลที่มีรูปแบบเป็น คู่ key กับ value เช่น map["Alice"] = 30;
-                                                                        function<void(int, int, int)> = เก็บ ฟังก์ชันที่ไม่คืนค่า (void) และรับ พารามิเตอร์ 3 ตัว ซึ่งแต่ละตัวมีประเภทเป็น int
-                                                                    */
-    unordered_map<string, int> reg_map;                             // สร้าง map ที่ไม่เรียงตามอักษร ไว้เก็บค่า value แต่ละ register
+    size_t size() const { return queues.size(); }
 
+    // เรียก job(worker, index) ครบทุก index แล้วค่อย return (job ต้องไม่ throw)
+    void run(size_t count, const function<void(size_t, size_t)> &job)
+    {
+        size_t workers = queues.size();
+        for (size_t w = 0; w < workers; w++)
+        {
+            for (size_t i = count * w / workers; i < count * (w + 1) / workers; i++)
+                queues[w].jobs.push_back(i);
+        }
+
+        auto worker = [&](size_t self) {
+            size_t index;
+            while (take(self, index))
+                job(self, index);
+        };
+        vector<thread> threads;
+        for (size_t w = 1; w < workers; w++)
+            threads.emplace_back(worker, w);
+        worker(0);
+        for (thread &t : threads)
+            t.join();
+    }
+
+private:
+    struct Queue
+    {
+        mutex lock;
+        deque<size_t> jobs;
+    };
+    vector<Queue> queues;
 
-    CPU()
+    bool take(size_t self, size_t &index)
     {
-        registers[0] = 0;     // Register 0 มีค่าเป็น 0 เท่านั้น(ห้ามเปลี่ยน)
-        initInstructionMap(); // ประกาศ function ทิ้งไว้
-        initRegisterMap();    // ประกาศ function ทิ้งไว้
+        {
+            Queue &own = queues[self];
+            lock_guard<mutex> guard(own.lock);
+            if (!own.jobs.empty())
+            {
+                index = own.jobs.back();
+                own.jobs.pop_back();
+                return true;
+            }
+        }
+        // ไม่มีงานเพิ่มระหว่างรัน ถ้าทุกคิวว่างแปลว่าหมดงานแล้ว
+        for (size_t i = 1; i < queues.size(); i++)
+        {
+            Queue &victim = queues[(self + i) % queues.size()];
+            lock_guard<mutex> guard(victim.lock);
+            if (!victim.jobs.empty())
+            {
+                index = victim.jobs.front();
+                victim.jobs.pop_front();
+                return true;
+            }
+        }
+        return false;
     }
+};
+
+/*  JSON แบบย่อ ใช้อ่าน manifest และเขียนผลของ batch mode
+    รองรับ object, array, string, ตัวเลขจำนวนเต็ม, true/false/null
+*/
+struct JsonValue
+{
+    enum Kind
+    {
+        JSON_NULL,
+        JSON_BOOL,
+        JSON_NUMBER,
+        JSON_STRING,
+        JSON_ARRAY,
+        JSON_OBJECT,
+    };
+    Kind kind = JSON_NULL;
+    bool boolean = false;
+    long long number = 0;
+    string text;
+    vector<JsonValue> items;
+    vector<pair<string, JsonValue>> fields;
 
+    // หา field ใน object (nullptr = ไม่มี)
+    const JsonValue *get(const string &key) const
+    {
+        for (const auto &field : fields)
+        {
+            if (field.first == key)
+                return &field.second;
+        }
+        return nullptr;
+    }
 
-    //  ค่า fix ไว้อยู่แล้ว(initRegisterMap ห้ามแก้!)
-    void initRegisterMap() // ทำให้ function initRegisterMap() กำหนดข้อมูลใน map register
+    // ค่าที่เป็นตัวเลข หรือ string ของตัวเลข เช่น "0x10010000"
+    long long integer() const
     {
+        if (kind == JSON_NUMBER)
+            return number;
+        if (kind == JSON_STRING)
+            return parseImm(text);
+        throw runtime_error("Expected a number");
+    }
+};
 
-        reg_map["$zero"] = 0; //$Zero Register เป็น Constant มีค่า 0 (เปลี่ยนแปลงไม่ได้)
-        reg_map["$at"] = 1;   // "$Assembler Temporary ทำหน้าที่เก็บข้อมูลชั่วคราวระหว่างการแปลรหัส assembly หรือช่วยในการคำนวณที่ซับซ้อนระหว่างการแปลรหัส
+class JsonParser
+{
+public:
+    explicit JsonParser(const string &text) : text(text) {}
 
-        // $Value เก็บค่า Result จากฟังก์ชันหรือการคำนวณ ใช้ใน system calls เพื่อบอก OS ว่าต้องการให้ทำอะไร ($v0 เก็บผลลัพธ์หลัก)($v1 เก็บผลลัพธ์รอง)
-        reg_map["$v0"] = 2;
-        reg_map["$v1"] = 3;
-        // $Arguments ข้อมูลที่ส่งให้กับฟังก์ชันเพื่อให้ฟังก์ชันนั้นสามารถทำงานได้
-        reg_map["$a0"] = 4;
-        reg_map["$a1"] = 5;
-        reg_map["$a2"] = 6;
-        reg_map["$a3"] = 7;
-        // $Temporary registers ชั่วคราว ที่ใช้ในการเก็บข้อมูลระหว่างการคำนวณหรือลำดับการดำเนินงานต่าง ๆ
+    JsonValue parse()
+    {
+        JsonValue value = parseValue();
+        skipSpace();
+        if (pos != text.size())
+            fail("unexpected text after value");
+        return value;
+    }
 
-        reg_map["$t0"] = 8;
-        reg_map["$t1"] = 9;
-        reg_map["$t2"] = 10;
-        reg_map["$t3"] = 11;
+private:
+    const string &text;
+    size_t pos = 0;
 
-        reg_map["$t4"] = 12;
-        reg_map["$t5"] = 13;
-        reg_map["$t6"] = 14;
-        reg_map["$t7"] = 15;
-        // $Saved Registers ที่เก็บค่าไว้ระหว่างการเรียกฟังก์ชัน
-        reg_map["$s0"] = 16;
-        reg_map["$s1"] = 17;
-        reg_map["$s2"] = 18;
-        reg_map["$s3"] = 19;
-        reg_map["$s4"] = 20;
-        reg_map["$s5"] = 21;
-        reg_map["$s6"] = 22;
-        reg_map["$s7"] = 23;
+    [[noreturn]] void fail(const string &message)
+    {
+        throw runtime_error("Invalid JSON at column " + to_string(pos + 1) + ": " + message);
+    }
 
-        // $Temporary registers ชั่วคราว ที่ใช้ในการเก็บข้อมูลระหว่างการคำนวณหรือลำดับการดำเนินงานต่าง ๆ
-        reg_map["$t8"] = 24;
-        reg_map["$t9"] = 25;
+    void skipSpace()
+    {
+        while (pos < text.size() && isspace((unsigned char)text[pos]))
+            pos++;
+    }
 
-        // Special Registers ตัวแปร พิเศษ
-        //$Kernel registers ใช้โดย OS ถูกสงวนไว้สำหรับการใช้งานของระบบปฏิบัติการ
-        reg_map["$k0"] = 26;
-        reg_map["$k1"] = 27;
+    void expect(char c)
+    {
+        skipSpace();
+        if (pos >= text.size() || text[pos] != c)
+            fail(string("expected '") + c + "'");
+        pos++;
+    }
 
-        reg_map["$gp"] = 28; // Global Pointer ชี้ไปยังตำแหน่งเริ่มต้นของ global data segment ซึ่งเป็นส่วนของหน่วยความจำที่เก็บข้อมูลที่สามารถเข้าถึงได้จากทั่วทั้งโปรแกรม
-        reg_map["$sp"] = 29; // Stack Pointer ชี้ไปยังตำแหน่งปัจจุบันของ stack ข้อมูลจะถูก push (บันทึก) หรือ pop (ดึงออก) ตามลำดับของ stack (LIFO
-        reg_map["$fp"] = 30; // Frame Pointer ชี้ไปยังตำแหน่งเริ่มต้นของ stack frame ของฟังก์ชันที่กำลังทำงาน
-        reg_map["$ra"] = 31; // Return Address ใช้เก็บ ที่อยู่ของคำสั่งถัดไป หลังจากที่เราเรียกฟังก์ชัน (หรือคำสั่ง) ใหม่
+    bool consume(const char *word)
+    {
+        size_t len = strlen(word);
+        if (text.compare(pos, len, word) != 0)
+            return false;
+        pos += len;
+        return true;
     }
 
-    //[this] การ "จับ" (capture) ตัวแปรของคลาสหรืออ็อบเจกต์ที่เรียกใช้งาน lambda function ในขณะนั้น
-    void initInstructionMap() // ที่เก็บการจับคู่ระหว่าง ชื่อคำสั่ง (instruction) กับ ฟังก์ชันที่ใช้จัดการคำสั่ง (lambda functions)
+    JsonValue parseValue()
     {
-        // บวก add $t0, $t1, $t2 [$t0 = $t1 + $t2]
-        instr_map["add"] = [this](int rd, int rs, int rt)
+        skipSpace();
+        if (pos >= text.size())
+            fail("unexpected end");
+        JsonValue value;
+        char c = text[pos];
+        if (c == '{')
         {
-            registers[rd] = registers[rs] + registers[rt];
-        };
-
-        // ลบ sub $t0, $t1, $t2 [$t0 = $t1 - $t2]
-        instr_map["sub"] = [this](int rd, int rs, int rt)
+            value.kind = JsonValue::JSON_OBJECT;
+            pos++;
+            skipSpace();
+            if (pos < text.size() && text[pos] == '}')
+            {
+                pos++;
+                return value;
+            }
+            while (true)
+            {
+                skipSpace();
+                string key = parseString();
+                expect(':');
+                value.fields.emplace_back(key, parseValue());
+                skipSpace();
+                if (pos < text.size() && text[pos] == ',')
+                {
+                    pos++;
+                    continue;
+                }
+                expect('}');
+                return value;
+            }
+        }
+        if (c == '[')
         {
-            registers[rd] = registers[rs] - registers[rt];
-        };
-
-        // คูณ mul $t0, $t1, $t2 [$t0 = $t1 * $t2]
-        instr_map["mul"] = [this](int rd, int rs, int rt)
+            value.kind = JsonValue::JSON_ARRAY;
+            pos++;
+            skipSpace();
+            if (pos < text.size() && text[pos] == ']')
+            {
+                pos++;
+                return value;
+            }
+            while (true)
+            {
+                value.items.push_back(parseValue());
+                skipSpace();
+                if (pos < text.size() && text[pos] == ',')
+                {
+                    pos++;
+                    continue;
+                }
+                expect(']');
+                return value;
+            }
+        }
+        if (c == '"')
         {
-            registers[rd] = registers[rs] * registers[rt];
-        };
-
-        /*  Load Word โหลดข้อมูลจาก Memory registers
-            lw $t0, offset($t1) [$t0 = memory[$t1 + offset]]
-            $t0: รีจิสเตอร์ที่ใช้เก็บข้อมูล
-            memory[$t1 + offset]:  ที่อยู่ในหน่วยความจำที่ต้องการโหลดข้อมูลมา ($t1เป็นเลข Word offset เป็นเลข byte)
-            offset มีการเปลี่ยนจาก byte เป็น word โดยการหาร 4
-        */
-        instr_map["lw"] = [this](int rt, int offset, int rs)
+            value.kind = JsonValue::JSON_STRING;
+            value.text = parseString();
+            return value;
+        }
+        if (consume("true"))
         {
-            registers[rt] = memory[registers[rs] + offset / 4];
-        };
-
-        /*  Store Word ใช้ในการเก็บค่าจาก register ลง Memory
-            sw $t0, offset($s1) [[$s1 + offset] = $t0]
-            เก็บค่าใน $t0 ลง memory[$s1 + offset]
-            memory[$s1 + offset]:  ที่อยู่ในหน่วยความจำที่ต้องการ save ($s1เป็นเลข Word offset เป็นเลข byte)
-            offset มีการเปลี่ยนจาก byte เป็น word โดยการหาร 4
-        */
-        instr_map["sw"] = [this](int rt, int offset, int rs)
+            value.kind = JsonValue::JSON_BOOL;
+            value.boolean = true;
+            return value;
+        }
+        if (consume("false"))
         {
-            memory[(registers[rs] + offset) / 4] = registers[rt];
-        };
+            value.kind = JsonValue::JSON_BOOL;
+            return value;
+        }
+        if (consume("null"))
+            return value;
+        if (c == '-' || isdigit((unsigned char)c))
+        {
+            size_t start = pos++;
+            while (pos < text.size() && isdigit((unsigned char)text[pos]))
+                pos++;
+            if (pos < text.size() && (text[pos] == '.' || text[pos] == 'e' || text[pos] == 'E'))
+                fail("only integer numbers are supported");
+            value.kind = JsonValue::JSON_NUMBER;
+            value.number = stoll(text.substr(start, pos - start));
+            return value;
+        }
+        fail("unexpected character");
+    }
 
-        /*  Load Immediate ใส่ค่าคงที่ลงใน register
-            li $t0, imm [$t0 = imm]
-        */
-        instr_map["li"] = [this](int rt, int imm, int dummy)
+    string parseString()
+    {
+        if (pos >= text.size() || text[pos] != '"')
+            fail("expected string");
+        pos++;
+        string out;
+        while (pos < text.size() && text[pos] != '"')
         {
-            registers[rt] = imm;
-        };
-      
-        /*  Branch if Equal กระโดดไปยังตำแหน่งอื่นของโปรแกรม หากค่าของรีจิสเตอร์สองตัวเท่ากัน
-            beq $rs, $rt, offset [if register[rs] == register[rt] กระโดดไปที่ PC + (offset*4)]
-            PC ใช้เป็น Byte Address offset เลย *4
-        */
-        instr_map["beq"] = [this](int rs, int rt, int offset)
-        {
-            if (registers[rs] == registers[rt])
+            char c = text[pos++];
+            if (c != '\\')
             {
-                PC += offset * 4;
+                out += c;
+                continue;
             }
-        };
-
-        /*  Branch if Not Equal กระโดดไปยังตำแหน่งอื่นของโปรแกรม หากค่าของรีจิสเตอร์สองตัวไม่เท่ากัน
-            bne $rs, $rt, offset [if register[rs] != register[rt] กระโดดไปที่ PC + (offset*4)]
-            PC ใช้เป็น Byte Address offset เลย *4
-        */
-        instr_map["bne"] = [this](int rs, int rt, int offset)
-        {
-            if (registers[rs] != registers[rt])
+            if (pos >= text.size())
+                break;
+            char e = text[pos++];
+            switch (e)
             {
-                PC += offset * 4;
+            case 'n': out += '\n'; break;
+            case 't': out += '\t'; break;
+            case 'r': out += '\r'; break;
+            case 'b': out += '\b'; break;
+            case 'f': out += '\f'; break;
+            case 'u': // รับแค่ตัวอักษร ASCII
+                if (pos + 4 > text.size())
+                    fail("bad \\u escape");
+                out += (char)stoi(text.substr(pos, 4), nullptr, 16);
+                pos += 4;
+                break;
+            default: out += e; break; // \" \\ \/
             }
-        };
+        }
+        if (pos >= text.size())
+            fail("unterminated string");
+        pos++;
+        return out;
+    }
+};
 
-        //  j target | Jump กระโดดไปยัง target ,PC ใช้ Byte address , target เป็น word address เลยต้อง *4
-        instr_map["j"] = [this](int target, int dummy1, int dummy2)
+// เขียน string เป็น JSON (ใส่ "" และ escape)
+static void writeJsonString(ostream &out, const string &text)
+{
+    out << '"';
+    for (char c : text)
+    {
+        if (c == '"' || c == '\\')
+            out << '\\' << c;
+        else if (c == '\n')
+            out << "\\n";
+        else if ((unsigned char)c < 0x20)
         {
-            PC = target * 4;
-        };
+            static const char digits[] = "0123456789abcdef";
+            out << "\\u00" << digits[(c >> 4) & 15] << digits[c & 15];
+        }
+        else
+            out << c;
+    }
+    out << '"';
+}
 
-        //  jal target |Jump and Link กระโดดไปยัง target จากนั้น บันทึกค่าที่อยู่ถัดไป(PC + 4) ลง $ra,PC ใช้ Byte address , target เป็น word address เลยต้อง *4
-        instr_map["jal"] = [this](int target, int dummy1, int dummy2)
+static void writeJson(ostream &out, const JsonValue &value)
+{
+    switch (value.kind)
+    {
+    case JsonValue::JSON_NULL: out << "null"; break;
+    case JsonValue::JSON_BOOL: out << (value.boolean ? "true" : "false"); break;
+    case JsonValue::JSON_NUMBER: out << value.number; break;
+    case JsonValue::JSON_STRING: writeJsonString(out, value.text); break;
+    case JsonValue::JSON_ARRAY:
+        out << '[';
+        for (size_t i = 0; i < value.items.size(); i++)
         {
-            registers[31] = PC + 4;
-            PC = target * 4;
-        };
-
-        //  jr register |Jump Register กระโดดไปยังที่อยู่ในรีจิสเตอร์ที่ระบุ
-        instr_map["jr"] = [this](int rs, int dummy1, int dummy2)
+            if (i)
+                out << ',';
+            writeJson(out, value.items[i]);
+        }
+        out << ']';
+        break;
+    case JsonValue::JSON_OBJECT:
+        out << '{';
+        for (size_t i = 0; i < value.fields.size(); i++)
         {
-            PC = registers[rs]; // ✅ กระโดดไปที่อยู่ที่เก็บใน rs
-        };
+            if (i)
+                out << ',';
+            writeJsonString(out, value.fields[i].first);
+            out << ':';
+            writeJson(out, value.fields[i].second);
+        }
+        out << '}';
+        break;
+    }
+}
 
-        /*  And นำค่า 2 ค่าใน register มา and กันและเก็บผลลัพธ์ในรีจิสเตอร์ เป็นการตรวจสอบค่าบิตแต่ละบิตในสองตัวเลข ถ้าบิตทั้งสองเป็น 1 ผลลัพธ์จะเป็น 1 แต่ถ้าไม่ใช่ ผลลัพธ์จะเป็น 0
-            and $rd, $rs, $rt [$rd = $rs and $rt]
-            ผลลัพธ์ default จะมีค่าเป็นเลขฐาน 2
-        */
-        instr_map["and"] = [this](int rd, int rs, int rt)
-        {
-            registers[rd] = registers[rs] & registers[rt];
-        };
+// ไฟล์ .asm / .s เป็น assembly นอกนั้นถือว่าเป็น machine code (ELF หรือ flat binary)
+static bool isAssemblyFile(const string &path)
+{
+    size_t dot = path.rfind('.');
+    string ext = dot == string::npos ? "" : path.substr(dot);
+    return ext == ".asm" || ext == ".s" || ext == ".S";
+}
 
-        /*  Or นำค่า 2 ค่าใน register มา or กันและเก็บผลลัพธ์ในรีจิสเตอร์ เป็นการตรวจสอบค่าบิตแต่ละบิตในสองตัวเลข ถ้าบิตอันใดอันหนึ่งเป็น 1 ผลลัพธ์จะเป็น 1 แต่ถ้าไม่ใช่ ผลลัพธ์จะเป็น 0
-            or $t0, $t1, $t2 [ $t0 = $t1 or $t2]
-            ผลลัพธ์ default จะมีค่าเป็นเลขฐาน 2
-        */
-        instr_map["or"] = [this](int rd, int rs, int rt)
-        {
-            registers[rd] = registers[rs] | registers[rt];
-        };
+// ตัวเลือกของ program mode (อ่านจาก command line)
+struct RunOptions
+{
+    string path;
+    long long max_instructions = LLONG_MAX;
+    uint32_t base = 0;       // --base: ตำแหน่งที่วาง flat binary
+    bool big_endian = true;  // --le: flat binary เป็น little endian
+    bool use_blocks = true;  // --interp: ใช้ CPU::run (ทีละคำสั่ง) แทน basic-block cache
 
-        /*  Set on Less Than กำหนดค่าเป็น 1 ถ้าค่าแรกน้อยกว่าค่า 2
-            slt $t0, $t1, $t2 [ $t0 = $t1 compare $t2]
-        */
-        instr_map["slt"] = [this](int rd, int rs, int rt)
-        {
-            registers[rd] = (registers[rs] < registers[rt]) ? 1 : 0;
-        };
-    }
+    // --cache หรือ --l1i/--l1d/--l2 size:ways:line[:lru|plru|random[:wb|wt[:latency]]] เปิด cache simulator
+    bool use_cache = false;
+    CacheConfig l1i;
+    CacheConfig l1d;
+    CacheConfig l2 = {256 * 1024, 8, 64, REPL_LRU, true, 10};
+    uint32_t memory_latency = 100; // --mem-latency
 
+    // --pipeline นับ cycle ด้วย pipeline 5 ขั้น, --branch-resolve id|ex, --predictor not-taken|bimodal|gshare
+    bool use_pipeline = false;
+    bool resolve_in_id = true;
+    PredictorKind predictor = PRED_NOT_TAKEN;
 
+    // --cores N รัน N core ใช้ memory ร่วมกัน (ดู MultiCore), --quantum Q จำนวนคำสั่งต่อรอบก่อน sync
+    size_t cores = 1;
+    long long quantum = 1000;
 
-    void execute(string instruction); // สร้าง function เปล่าๆ มาเขียนแยกทีหลัง ทำงานโดยใช้ string
-    void printRegisters();            // สร้าง function เปล่าๆ มาเขียนแยกทีหลัง เป็น function void
-};
+    // --batch: ไฟล์ที่ให้มาเป็น manifest (JSON 1 งานต่อบรรทัด) ดู runBatchMode, --threads จำนวน host thread (0 = เท่าจำนวน core ของเครื่อง)
+    bool batch = false;
+    size_t threads = 0;
+    size_t lanes = 1; // --lanes k: รันงานที่ใช้ program เดียวกันทีละ k งานพร้อมกันด้วย LockstepCPU (SIMD)
+
+    // --profile พิมพ์สรุป profile และเขียน flat profile ลง --profile-out (ค่าเริ่มต้น = ชื่อโปรแกรม + ".prof")
+    bool profile = false;
+    string profile_out;
+
+    // --trace file เขียน trace ทุกคำสั่ง (--trace-raw = ไม่บีบอัด), --read-trace file แปลง trace เป็นข้อความแล้วจบ
+    string trace_path;
+    bool trace_compress = true;
+    string read_trace;
 
-//-----------------------------------------------NOTE : แปลให้ทุกอย่างยกเว้นส่วน executeเพราะงั้น comment ใน CPU::execute ทุกอันจะเป็นของ ChatGPT -----------------------------------------------
+    // --checkpoint file เก็บสถานะตอนจบการรัน (ใช้ max_instructions เลือกจุด), --restore file เริ่มรันต่อจาก checkpoint
+    string checkpoint_path;
+    string restore_path;
+};
 
-// function exucute
-void CPU::execute(string instruction)
+// อ่านขนาดแบบ 32K / 1M / 4096
+static uint32_t parseSize(const string &text)
 {
-    string op, rd, rs, rt;
-    istringstream iss(instruction);
+    char unit = text.empty() ? 0 : (char)toupper((unsigned char)text.back());
+    uint32_t scale = unit == 'K' ? 1024 : unit == 'M' ? 1024 * 1024 : 1;
+    return (uint32_t)parseImm(scale == 1 ? text : text.substr(0, text.size() - 1)) * scale;
+}
 
-    // อ่านคำสั่งตัวแรกก,
-    iss >> op;
+// อ่าน config ของ cache รูปแบบ size:ways:line[:policy[:wb|wt[:latency]]]
+static CacheConfig parseCacheConfig(const string &spec, CacheConfig cfg)
+{
+    vector<string> fields;
+    string field;
+    istringstream iss(spec);
+    while (getline(iss, field, ':'))
+        fields.push_back(field);
+    if (fields.size() < 3 || fields.size() > 6)
+        throw runtime_error("Invalid cache config: " + spec);
+    cfg.size = parseSize(fields[0]);
+    cfg.ways = (uint32_t)parseImm(fields[1]);
+    cfg.line = (uint32_t)parseImm(fields[2]);
+    if (fields.size() > 3)
+    {
+        if (fields[3] == "lru")
+            cfg.policy = REPL_LRU;
+        else if (fields[3] == "plru")
+            cfg.policy = REPL_PLRU;
+        else if (fields[3] == "random")
+            cfg.policy = REPL_RANDOM;
+        else
+            throw runtime_error("Unknown replacement policy: " + fields[3]);
+    }
+    if (fields.size() > 4)
+    {
+        if (fields[4] != "wb" && fields[4] != "wt")
+            throw runtime_error("Write policy must be wb or wt: " + fields[4]);
+        cfg.write_back = fields[4] == "wb";
+    }
+    if (fields.size() > 5)
+        cfg.hit_latency = (uint32_t)parseImm(fields[5]);
+    return cfg;
+}
 
-    // คำสั่งประเภท jump (J, Jal , Jr)
-    if (op == "jr")
+static RunOptions parseOptions(const vector<string> &args)
+{
+    RunOptions opts;
+    size_t i = 0;
+    for (; i < args.size() && args[i].rfind("--", 0) == 0; i++)
     {
-        if (!(iss >> rs))
+        if (args[i] == "--le")
+            opts.big_endian = false;
+        else if (args[i] == "--base" && i + 1 < args.size())
+            opts.base = (uint32_t)parseImm(args[++i]);
+        else if (args[i] == "--interp")
+            opts.use_blocks = false;
+        else if (args[i] == "--cache")
+            opts.use_cache = true;
+        else if ((args[i] == "--l1i" || args[i] == "--l1d" || args[i] == "--l2") && i + 1 < args.size())
         {
-            throw runtime_error("Missing register in " + instruction);
+            CacheConfig &cfg = args[i] == "--l1i" ? opts.l1i : args[i] == "--l1d" ? opts.l1d : opts.l2;
+            cfg = parseCacheConfig(args[i + 1], cfg);
+            opts.use_cache = true;
+            i++;
         }
-        if (reg_map.find(rs) == reg_map.end())
+        else if (args[i] == "--mem-latency" && i + 1 < args.size())
+            opts.memory_latency = (uint32_t)parseImm(args[++i]);
+        else if (args[i] == "--pipeline")
+            opts.use_pipeline = true;
+        else if (args[i] == "--branch-resolve" && i + 1 < args.size())
         {
-            throw runtime_error("Invalid register: " + rs);
+            string stage = args[++i];
+            if (stage != "id" && stage != "ex")
+                throw runtime_error("--branch-resolve must be id or ex");
+            opts.resolve_in_id = stage == "id";
+            opts.use_pipeline = true;
         }
-        int rs_index = reg_map[rs];
-        instr_map["jr"](reg_map[rs], 0, 0);
-
-        return;
+        else if (args[i] == "--predictor" && i + 1 < args.size())
+        {
+            string kind = args[++i];
+            if (kind == "not-taken")
+                opts.predictor = PRED_NOT_TAKEN;
+            else if (kind == "bimodal")
+                opts.predictor = PRED_BIMODAL;
+            else if (kind == "gshare")
+                opts.predictor = PRED_GSHARE;
+            else
+                throw runtime_error("Unknown predictor: " + kind);
+            opts.use_pipeline = true;
+        }
+        else if (args[i] == "--cores" && i + 1 < args.size())
+            opts.cores = (size_t)parseImm(args[++i]);
+        else if (args[i] == "--quantum" && i + 1 < args.size())
+            opts.quantum = parseImm(args[++i]);
+        else if (args[i] == "--profile")
+            opts.profile = true;
+        else if (args[i] == "--profile-out" && i + 1 < args.size())
+        {
+            opts.profile_out = args[++i];
+            opts.profile = true;
+        }
+        else if (args[i] == "--trace" && i + 1 < args.size())
+            opts.trace_path = args[++i];
+        else if (args[i] == "--trace-raw")
+            opts.trace_compress = false;
+        else if (args[i] == "--read-trace" && i + 1 < args.size())
+            opts.read_trace = args[++i];
+        else if (args[i] == "--checkpoint" && i + 1 < args.size())
+            opts.checkpoint_path = args[++i];
+        else if (args[i] == "--restore" && i + 1 < args.size())
+            opts.restore_path = args[++i];
+        else if (args[i] == "--batch")
+            opts.batch = true;
+        else if (args[i] == "--threads" && i + 1 < args.size())
+            opts.threads = (size_t)parseImm(args[++i]);
+        else if (args[i] == "--lanes" && i + 1 < args.size())
+            opts.lanes = (size_t)parseImm(args[++i]);
+        else
+            throw runtime_error("Unknown option: " + args[i]);
     }
+    if (opts.cores == 0)
+        throw runtime_error("--cores must be at least 1");
+    if (opts.quantum <= 0)
+        throw runtime_error("--quantum must be positive");
+    if (opts.cores > 1 && (opts.use_cache || opts.use_pipeline))
+        throw runtime_error("--cache and --pipeline support a single core only");
+    if (opts.lanes == 0)
+        throw runtime_error("--lanes must be at least 1");
+    if (opts.lanes > 1 && !opts.batch)
+        throw runtime_error("--lanes needs --batch");
+    if (opts.batch && (opts.cores > 1 || opts.use_cache || opts.use_pipeline))
+        throw runtime_error("--batch supports the functional engines only");
+    if (opts.profile && (opts.batch || opts.cores > 1))
+        throw runtime_error("--profile supports a single core only");
+    if (!opts.trace_path.empty() && (opts.batch || opts.cores > 1 || opts.use_pipeline))
+        throw runtime_error("--trace supports a single core without --pipeline only");
+    if ((!opts.checkpoint_path.empty() || !opts.restore_path.empty()) && (opts.batch || opts.cores > 1))
+        throw runtime_error("--checkpoint and --restore support a single core only");
+    if (i >= args.size() && (!opts.read_trace.empty() || !opts.restore_path.empty()))
+        return opts;
+    if (i >= args.size())
+        throw runtime_error("Missing program file");
+    // --restore ไม่ต้องระบุโปรแกรม: sim_cpu --restore file 1000 = รันต่ออีก 1000 คำสั่ง
+    if (!opts.restore_path.empty() && i + 1 == args.size() && args[i].find_first_not_of("0123456789") == string::npos)
+    {
+        opts.max_instructions = stoll(args[i]);
+        return opts;
+    }
+    opts.path = args[i];
+    if (i + 1 < args.size())
+        opts.max_instructions = stoll(args[i + 1]);
+    return opts;
+}
 
-    if (op == "j" || op == "jal")
+/*  Program mode แบบหลาย core: max_instructions นับแยกแต่ละ core
+    print ผลของทุก core แล้วตามด้วย register ของแต่ละ core
+*/
+static int runMultiCoreMode(const RunOptions &opts)
+{
+    MultiCore machine(opts.cores);
+    try
     {
-        string target_str;
-        if (!(iss >> target_str))
+        CPU &first = *machine.cores[0];
+        Program prog = isAssemblyFile(opts.path) ? first.loadProgram(opts.path) : first.loadBinary(opts.path, opts.base, opts.big_endian);
+        try
         {
-            throw runtime_error("Invalid jump format: " + instruction);
+            machine.load(prog);
         }
-        // ถ้าไม่เกี่ยวค่อยลบ
-        int target = stoi(target_str);
-        instr_map[op](target, 0, 0);
-        return;
+        catch (const MemoryFault &e) // segment อยู่นอก memory ของ user ยังไม่มี core ไหนรัน จึงไม่มี core / PC ให้รายงาน
+        {
+            throw runtime_error(string("Cannot load program: ") + e.what());
+        }
+        long long total = machine.run(opts.max_instructions, opts.quantum, opts.use_blocks);
+        cout << "Executed " << total << " instructions on " << opts.cores << " cores\n";
+        for (size_t i = 0; i < machine.cores.size(); i++)
+        {
+            CPU &cpu = *machine.cores[i];
+            cout << "Core " << i << ": " << machine.executed[i] << " instructions"
+                 << (cpu.halted() ? " (halted)" : " (instruction limit reached)") << ", PC = " << cpu.PC << "\n";
+        }
+        cout << "Memory used = " << first.memory.pageCount() * Memory::PAGE_SIZE / 1024 << " KB\n";
+        for (size_t i = 0; i < machine.cores.size(); i++)
+        {
+            cout << "--- Core " << i << " ---\n";
+            machine.cores[i]->printRegisters();
+        }
+    }
+    catch (const MemoryFault &e)
+    {
+        cerr << "Error: " << e.what();
+        if (machine.fault_core >= 0) // fault ตอนรัน: PC ของ core นั้นเลื่อนไปแล้ว คำสั่งที่ error คือ PC - 4
+            cerr << " (core " << machine.fault_core << ", PC 0x" << hex << (uint32_t)(machine.cores[machine.fault_core]->PC - 4) << dec << ")";
+        cerr << endl;
+        return 1;
     }
+    catch (const exception &e)
+    {
+        cerr << "Error: " << e.what() << endl;
+        return 1;
+    }
+    return 0;
+}
 
-    // คำสั่งประเภท branch (BEQ, BNE)
-    if (op == "beq" || op == "bne")
+/*  โปรแกรมที่โหลดแล้วของ batch mode แยกตาม path โหลดและถอดรหัสครั้งเดียว ทุกงานใช้ Program เดียวกันแบบอ่านอย่างเดียว
+    (CPU ที่มี sw เขียนทับ text จะ copy code ไปเป็นของตัวเอง ดู CPU::writeCode)
+*/
+class ProgramCache
+{
+public:
+    explicit ProgramCache(const RunOptions &opts) : opts(opts) {}
+
+    const Program &get(CPU &cpu, const string &path)
     {
-        string rs_str, rt_str, offset_str;
-        if (!(iss >> rs_str >> rt_str >> offset_str))
-        {
-            throw runtime_error("Invalid " + op + " format: " + op + " $rs, $rt, offset");
-        } // ถ้า check ข้างบนแล้วค่ามันผิดลบ + op + " $rs, $rt, offset"
-        if (reg_map.find(rs_str) == reg_map.end() || reg_map.find(rt_str) == reg_map.end())
+        Entry *entry;
         {
-            throw runtime_error("Invalid register in " + op + ": " + rs_str + ", " + rt_str);
-        } // ถ้า check ข้างบนแล้วค่ามันผิดลบ  ": " + rs_str + ", " + rt_str
-        int rs_index = reg_map[rs_str];
-        int rt_index = reg_map[rt_str];
-        int offset = stoi(offset_str);
-        instr_map[op](rs_index, rt_index, offset);
-        return;
+            lock_guard<mutex> guard(lock);
+            unique_ptr<Entry> &slot = entries[path];
+            if (!slot)
+                slot.reset(new Entry());
+            entry = slot.get();
+        }
+        call_once(entry->once, [&] {
+            try
+            {
+                entry->prog = isAssemblyFile(path) ? cpu.loadProgram(path) : cpu.loadBinary(path, opts.base, opts.big_endian);
+            }
+            catch (const exception &e)
+            {
+                entry->error = e.what();
+            }
+        });
+        if (!entry->error.empty())
+            throw runtime_error(entry->error);
+        return entry->prog;
     }
 
-    // คำสั่ง Load Immediate (LI)
-    if (op == "li")
+private:
+    struct Entry
+    {
+        once_flag once;
+        Program prog;
+        string error;
+    };
+    const RunOptions &opts;
+    mutex lock;
+    unordered_map<string, unique_ptr<Entry>> entries;
+};
+
+// เขียนผลของแต่ละงานออก stdout ตามลำดับใน manifest ถึงงานจะเสร็จไม่เรียงกัน
+class OrderedWriter
+{
+public:
+    OrderedWriter(ostream &out, size_t count) : out(out), lines(count), done(count, false) {}
+
+    void put(size_t index, string line)
     {
-        string rt_str, imm_str;
-        if (!(iss >> rt_str >> imm_str))
+        lock_guard<mutex> guard(lock);
+        lines[index] = move(line);
+        done[index] = true;
+        while (next < done.size() && done[next])
         {
-            cout << op + rt_str + imm_str;
-            throw runtime_error("Invalid LI");
+            out << lines[next] << '\n';
+            string().swap(lines[next]);
+            next++;
         }
-        if (reg_map.find(rt_str) == reg_map.end())
+    }
+
+private:
+    ostream &out;
+    mutex lock;
+    vector<string> lines;
+    vector<bool> done;
+    size_t next = 0;
+};
+
+// address ใน manifest เป็นชื่อ label ใน .data หรือตัวเลข
+static uint32_t manifestAddress(const Program &prog, const string &key)
+{
+    auto label = prog.data_labels.find(key);
+    if (label != prog.data_labels.end())
+        return label->second;
+    try
+    {
+        return (uint32_t)parseImm(key);
+    }
+    catch (const logic_error &)
+    {
+        throw runtime_error("Unknown label or address: " + key);
+    }
+}
+
+/*  ใส่ค่าเริ่มต้นของงาน ("regs" / "memory" ใน manifest) หลังโหลดโปรแกรมแล้ว
+    reg(r) คืน reference ของ register r (ใช้ได้ทั้ง CPU และ lane ของ LockstepCPU)
+*/
+template <class RegAccess>
+static void setupJob(CPU &cpu, const JsonValue &spec, const Program &prog, RegAccess reg, Memory &memory)
+{
+    if (const JsonValue *regs = spec.get("regs"))
+    {
+        for (const auto &field : regs->fields)
+            reg(cpu.regIndex(field.first, "regs")) = (int)field.second.integer();
+        reg(0) = 0;
+    }
+    if (const JsonValue *mem = spec.get("memory"))
+    {
+        for (const auto &field : mem->fields)
         {
-            throw runtime_error("Runtime:" + rt_str);
+            uint32_t addr = manifestAddress(prog, field.first);
+            if (field.second.kind != JsonValue::JSON_ARRAY)
+                memory.write32(addr, (uint32_t)field.second.integer());
+            for (const JsonValue &word : field.second.items)
+            {
+                memory.write32(addr, (uint32_t)word.integer());
+                addr += 4;
+            }
         }
-        int rt_index = reg_map[rt_str];
-        int imm = stoi(imm_str);
+    }
+}
 
-        instr_map["li"](rt_index, imm, 0);
-        return;
+// ผลของงานที่รันจบ (ต่อจาก "job" / "id" ที่เขียนไปแล้ว): จำนวนคำสั่ง, PC, register และ word ที่ขอใน "dump"
+template <class RegAccess>
+static void writeJobResult(ostream &out, const JsonValue &spec, const Program &prog, long long executed, bool halted, int pc,
+                           RegAccess reg, Memory &memory)
+{
+    out << ",\"executed\":" << executed << ",\"halted\":" << (halted ? "true" : "false") << ",\"pc\":" << pc << ",\"regs\":[";
+    for (int r = 0; r < 32; r++)
+        out << (r ? "," : "") << reg(r);
+    out << "]";
+    if (const JsonValue *dump = spec.get("dump"))
+    {
+        out << ",\"memory\":{";
+        for (size_t i = 0; i < dump->fields.size(); i++)
+        {
+            uint32_t addr = manifestAddress(prog, dump->fields[i].first);
+            long long words = dump->fields[i].second.integer();
+            out << (i ? "," : "");
+            writeJsonString(out, dump->fields[i].first);
+            out << ":[";
+            for (long long w = 0; w < words; w++)
+                out << (w ? "," : "") << (int)memory.read32(addr + 4 * (uint32_t)w);
+            out << "]";
+        }
+        out << "}";
     }
+}
 
-    // คำสั่ง Load/Store (LW , Sw)
-    if (op == "lw" || op == "sw")
+// "id" ของงาน (ถ้ามี) ต่อจาก "job"
+static void writeJobId(ostream &out, const JsonValue &spec)
+{
+    if (const JsonValue *id = spec.get("id"))
     {
-        string rt_str, offset_rs;
-        if (!(iss >> rt_str))
-            throw runtime_error("Missing destination register in " + instruction);
-        getline(iss >> ws, offset_rs);
-        size_t open_paren = offset_rs.find('('), close_paren = offset_rs.find(')');
-        if (open_paren == string::npos || close_paren == string::npos)
-            throw runtime_error("Invalid format for " + op);
-        string offset_str = offset_rs.substr(0, open_paren);
-        string rs_str = offset_rs.substr(open_paren + 1, close_paren - open_paren - 1);
-        if (reg_map.find(rt_str) == reg_map.end() || reg_map.find(rs_str) == reg_map.end())
-            throw runtime_error("Invalid register");
-        instr_map[op](reg_map[rt_str], stoi(offset_str), reg_map[rs_str]);
-        return;
+        out << ",\"id\":";
+        writeJson(out, *id);
     }
+}
+
+// รันงานเดียวด้วย CPU (reset ใหม่) คืนผล 1 บรรทัด error ใดๆ กลายเป็น "error" ของงานนั้น
+static string runJob(CPU &cpu, ProgramCache &programs, const RunOptions &opts, const string &line, size_t index,
+                     long long &executed, bool &ok)
+{
+    ostringstream out;
+    out << "{\"job\":" << index;
+    ok = false;
+    executed = 0;
+    try
+    {
+        JsonValue spec = JsonParser(line).parse();
+        writeJobId(out, spec);
+        const JsonValue *path = spec.get("program");
+        if (!path || path->kind != JsonValue::JSON_STRING)
+            throw runtime_error("Job needs a \"program\" string");
+        const Program &prog = programs.get(cpu, path->text);
+
+        cpu.reset();
+        cpu.load(prog);
+        auto reg = [&](int r) -> int & { return cpu.registers[r]; };
+        setupJob(cpu, spec, prog, reg, cpu.memory);
+        const JsonValue *max_value = spec.get("max");
+        long long max_instructions = max_value ? max_value->integer() : opts.max_instructions;
 
-    if (!(iss >> rd >> rs >> rt))
-        throw runtime_error("Invalid format for " + op);
-    if (reg_map.find(rd) == reg_map.end() || reg_map.find(rs) == reg_map.end() || reg_map.find(rt) == reg_map.end())
-        throw runtime_error("Invalid register in " + op);
-    // เรียกใช้งาน lambda function ตามคำสั่ง
-    instr_map[op](reg_map[rd], reg_map[rs], reg_map[rt]);
+        executed = opts.use_blocks ? cpu.runBlocks(max_instructions) : cpu.run(max_instructions);
+        writeJobResult(out, spec, prog, executed, cpu.halted(), cpu.PC, reg, cpu.memory);
+        ok = true;
+    }
+    catch (const exception &e)
+    {
+        out << ",\"error\":";
+        writeJsonString(out, e.what());
+    }
+    out << "}";
+    return out.str();
 }
 
-void CPU::printRegisters() // print ค่าในทุก register
+/*  Batch mode: sim_cpu --batch [--threads n] [--lanes k] manifest.jsonl [max_instructions]
+    manifest มี 1 งานต่อบรรทัด เช่น
+        {"id": "case-1", "program": "sum.asm", "regs": {"$a0": 5}, "memory": {"array": [1, 2, 3]}, "max": 100000, "dump": {"array": 3}}
+    program ต้องมี นอกนั้นไม่ใส่ก็ได้ (memory เขียนทีละ word เริ่มที่ address/label, dump อ่าน word กลับมาใส่ในผล)
+    ผลออก stdout 1 บรรทัดต่องานตามลำดับใน manifest ส่วนสรุปเวลาออก stderr
+    แต่ละ worker ใช้ CPU ตัวเดียว reset ใหม่ทุกงาน
+    --lanes k: งานที่อยู่ติดกันและใช้ program เดียวกันสูงสุด k งานรวมเป็นกลุ่มเดียว รันพร้อมกันด้วย LockstepCPU
+    งานที่ error ใน lockstep (หรือตั้งค่าไม่ได้) จะรันใหม่ด้วย CPU ทีละงาน ผลจึงเหมือนไม่ใส่ --lanes ทุกตัวอักษร
+*/
+static int runBatchMode(const RunOptions &opts)
 {
-    void CPU::printRegisters() {
-    cout << "Register values:\n";
+    ifstream manifest(opts.path);
+    if (!manifest)
+    {
+        cerr << "Error: Cannot open manifest: " << opts.path << endl;
+        return 1;
+    }
+    vector<string> lines;
+    string line;
+    while (getline(manifest, line))
+    {
+        if (line.find_first_not_of(" \t\r") != string::npos)
+            lines.push_back(line);
+    }
 
-    vector<pair<string, int>> sorted_registers;//สร้างตัวแปร Vector ที่เป็นชนิดคู่(pair) ซึ่งเอา string มาคู่กับ int 
-    for (const auto &r : reg_map) {//เอาค่าใน reg_map ใส่ลง vector
-        sorted_registers.push_back({r.first, r.second});
+    // แบ่งกลุ่ม: งาน [groups[g], groups[g + 1]) ใช้ program เดียวกัน (งานที่อ่าน manifest ไม่ได้อยู่กลุ่มเดียว ให้ runJob รายงาน error)
+    vector<JsonValue> specs(lines.size());
+    vector<string> program_of(lines.size());
+    vector<size_t> groups;
+    for (size_t i = 0; i < lines.size(); i++)
+    {
+        if (opts.lanes > 1)
+        {
+            try
+            {
+                specs[i] = JsonParser(lines[i]).parse();
+                const JsonValue *path = specs[i].get("program");
+                if (path && path->kind == JsonValue::JSON_STRING)
+                    program_of[i] = path->text;
+            }
+            catch (const exception &)
+            {
+            }
+        }
+        bool join = !groups.empty() && !program_of[i].empty() && program_of[i] == program_of[i - 1] &&
+                    i - groups.back() < opts.lanes;
+        if (!join)
+            groups.push_back(i);
     }
+    size_t group_count = groups.size();
+    groups.push_back(lines.size());
+
+    size_t threads = opts.threads ? opts.threads : max(1u, thread::hardware_concurrency());
+    WorkStealingPool pool(min(threads, max<size_t>(group_count, 1)));
+    vector<unique_ptr<CPU>> cpus(pool.size());
+    vector<unique_ptr<LockstepCPU>> lockstep(pool.size());
+    ProgramCache programs(opts);
+    OrderedWriter writer(cout, lines.size());
+    atomic<long long> total_executed{0};
+    atomic<size_t> failed{0};
+    atomic<long long> lane_executed{0}; // จำนวนคำสั่ง (รวมทุก lane) และจำนวนครั้งที่ issue ของ lockstep
+    atomic<long long> issued{0};
+
+    // งานที่ index ด้วย CPU ธรรมดา
+    auto runAlone = [&](CPU &cpu, size_t index) {
+        long long executed;
+        bool ok;
+        string result = runJob(cpu, programs, opts, lines[index], index, executed, ok);
+        total_executed += executed;
+        if (!ok)
+            failed++;
+        writer.put(index, move(result));
+    };
+
+    auto start = chrono::steady_clock::now();
+    pool.run(group_count, [&](size_t worker, size_t g) {
+        if (!cpus[worker])
+            cpus[worker].reset(new CPU());
+        CPU &cpu = *cpus[worker];
+        size_t first = groups[g], count = groups[g + 1] - first;
+        if (count == 1)
+        {
+            runAlone(cpu, first);
+            return;
+        }
+
+        if (!lockstep[worker])
+            lockstep[worker].reset(new LockstepCPU((uint32_t)opts.lanes));
+        LockstepCPU &group = *lockstep[worker];
+        vector<bool> alone(count, true); // งานที่ต้องรันใหม่ด้วย CPU
+        try
+        {
+            const Program &prog = programs.get(cpu, program_of[first]);
+            group.load(prog);
+            vector<long long> limits(group.lanes, 0);
+            for (uint32_t lane = 0; lane < group.lanes; lane++)
+            {
+                group.fault[lane] = "unused";
+                if (lane >= count)
+                    continue;
+                const JsonValue &spec = specs[first + lane];
+                try
+                {
+                    setupJob(cpu, spec, prog, [&](int r) -> int32_t & { return group.reg(lane, r); }, group.memory[lane]);
+                    const JsonValue *max_value = spec.get("max");
+                    limits[lane] = max_value ? max_value->integer() : opts.max_instructions;
+                    group.fault[lane].clear();
+                }
+                catch (const exception &)
+                {
+                }
+            }
+            uint64_t issued_before = group.issued;
+            lane_executed += group.run(limits);
+            issued += (long long)(group.issued - issued_before);
+
+            for (uint32_t lane = 0; lane < count; lane++)
+            {
+                if (!group.fault[lane].empty())
+                    continue;
+                const JsonValue &spec = specs[first + lane];
+                ostringstream out;
+                out << "{\"job\":" << first + lane;
+                writeJobId(out, spec);
+                try
+                {
+                    writeJobResult(out, spec, prog, group.executed[lane], group.halted(lane), (int)group.pc[lane],
+                                   [&](int r) -> int32_t & { return group.reg(lane, r); }, group.memory[lane]);
+                }
+                catch (const exception &)
+                {
+                    continue; // dump อ่านไม่ได้: ให้ runJob เขียน error
+                }
+                out << "}";
+                total_executed += group.executed[lane];
+                writer.put(first + lane, out.str());
+                alone[lane] = false;
+            }
+        }
+        catch (const exception &)
+        {
+        }
+        for (size_t lane = 0; lane < count; lane++)
+        {
+            if (alone[lane])
+                runAlone(cpu, first + lane);
+        }
+    });
+    double seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
 
-    // sortค่าตาม registermap int จากน้อยไปมาก
-    sort(sorted_registers.begin(), sorted_registers.end(), 
-         [](const pair<string, int> &a, const pair<string, int> &b) {//รับ parameter pair<string, int> มาใส่เป็น address ของ a และ b
-             return a.second < b.second; //ทำให้เรียงลำดับจากน้อยไปมาก
-         });
+    cerr << "Batch: " << lines.size() << " jobs (" << failed.load() << " failed) on " << pool.size() << " threads, "
+         << total_executed.load() << " instructions in " << seconds << " s";
+    if (seconds > 0)
+        cerr << " (" << total_executed.load() / seconds / 1e6 << " MIPS)";
+    if (opts.lanes > 1)
+    {
+        cerr << ", " << opts.lanes << " lanes (" << LockstepCPU::simdName() << ")";
+        if (issued.load())
+            cerr << " " << 100.0 * lane_executed.load() / ((double)issued.load() * opts.lanes) << "% lane utilization";
+    }
+    cerr << endl;
+    return failed.load() ? 1 : 0;
+}
 
-    // แสดงผลตามลำดับที่ถูกต้อง
-    for (const auto &r : reg_map)
+#if SIM_PROFILE
+// เขียน flat profile ลงไฟล์ ถ้าเป็น .asm จะอ่านไฟล์อีกรอบเพื่อเอาข้อความของแต่ละบรรทัด
+static void writeFlatProfile(const Profile &profile, const Program &prog, const RunOptions &opts)
+{
+    vector<string> source;
+    if (isAssemblyFile(opts.path))
     {
-        cout << r.first << " = " << registers[r.second] << "\n";
+        ifstream file(opts.path);
+        string line;
+        while (getline(file, line))
+            source.push_back(line);
     }
-    /*for loop
-    r.first คือ ค่าของ reg_map key(string)
-    r.second คือ ค่า ของ reg_map value(int)
-    registers[r.second] คือ เอาค่าเลขของ r.second มาค้นใน array ตำแหน่ง registers
-    */
+    string path = opts.profile_out.empty() ? opts.path + ".prof" : opts.profile_out;
+    ofstream out(path);
+    if (!out)
+        throw runtime_error("Cannot write profile: " + path);
+    profile.writeFlatProfile(out, prog, source);
+    cout << "  Flat profile written to " << path << "\n";
 }
+#endif
 
-int main() // start
+/*  Program mode: sim_cpu [options] program [max_instructions]
+    โหลดทั้งไฟล์ แล้วรันตาม PC จนจบโปรแกรม (PC ออกนอกโปรแกรม) หรือครบจำนวนคำสั่ง
+    print register แค่ครั้งเดียวตอนจบ
+*/
+int runProgramMode(CPU &cpu, const RunOptions &opts)
+{
+    if (!opts.read_trace.empty())
+    {
+        try
+        {
+            readTrace(opts.read_trace, cout);
+        }
+        catch (const exception &e)
+        {
+            cerr << "Error: " << e.what() << endl;
+            return 1;
+        }
+        return 0;
+    }
+    if (opts.batch)
+        return runBatchMode(opts);
+    if (opts.cores > 1)
+        return runMultiCoreMode(opts);
+    try
+    {
+        // --restore: โปรแกรมและวิธีโหลดมาจาก checkpoint (ถ้าไม่ได้ระบุไฟล์โปรแกรมเอง)
+        RunOptions run = opts;
+        unique_ptr<Checkpoint> checkpoint;
+        if (!opts.restore_path.empty())
+        {
+            checkpoint.reset(new Checkpoint(opts.restore_path));
+            if (run.path.empty())
+                run.path = checkpoint->program;
+            run.base = checkpoint->base;
+            run.big_endian = checkpoint->big_endian;
+        }
+
+        Program prog = isAssemblyFile(run.path) ? cpu.loadProgram(run.path) : cpu.loadBinary(run.path, run.base, run.big_endian);
+        try
+        {
+            cpu.load(prog, !checkpoint);
+        }
+        catch (const MemoryFault &e) // segment อยู่นอก memory ของ user ยังไม่ได้รันคำสั่งไหน จึงไม่มี PC ให้รายงาน
+        {
+            throw runtime_error(string("Cannot load program: ") + e.what());
+        }
+        unique_ptr<CacheHierarchy> caches;
+        if (opts.use_cache)
+        {
+            caches.reset(new CacheHierarchy(opts.l1i, opts.l1d, opts.l2));
+            caches->memory_latency = opts.memory_latency;
+            cpu.caches = caches.get();
+        }
+        Pipeline pipe(BranchPredictor(opts.predictor), opts.resolve_in_id);
+        long long before = 0; // จำนวนคำสั่งที่ทำไปแล้วใน checkpoint
+        if (checkpoint)
+        {
+            checkpoint->restore(cpu, prog, caches.get(), opts.use_pipeline ? &pipe.predictor : nullptr);
+            before = checkpoint->executed;
+            cout << "Restored checkpoint at instruction " << before << "\n";
+        }
+        Profile profile;
+        if (opts.profile)
+        {
+            profile.attach(prog);
+            cpu.profile = &profile;
+        }
+        unique_ptr<TraceWriter> trace;
+        if (!opts.trace_path.empty())
+            trace.reset(new TraceWriter(opts.trace_path, opts.trace_compress));
+        auto start = chrono::steady_clock::now();
+        long long executed = trace               ? cpu.runTrace(*trace, opts.max_instructions)
+                             : opts.use_pipeline ? cpu.runPipeline(pipe, opts.max_instructions)
+                             : opts.use_blocks   ? cpu.runBlocks(opts.max_instructions)
+                                                 : cpu.run(opts.max_instructions);
+        if (trace)
+            trace->close();
+        profile.seconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+        profile.retired = executed;
+        cout << "Executed " << executed << " instructions"
+             << (cpu.halted() ? " (halted)" : " (instruction limit reached)") << "\n";
+        cout << "PC = " << cpu.PC << "\n";
+        cout << "Memory used = " << cpu.memory.pageCount() * Memory::PAGE_SIZE / 1024 << " KB\n";
+        if (caches)
+            caches->report(cout);
+        if (opts.use_pipeline)
+            pipe.report(cout);
+        if (trace)
+            cout << "Trace: " << trace->records() << " records, " << trace->bytesWritten() << " bytes written to " << opts.trace_path << "\n";
+        if (opts.profile)
+        {
+            profile.report(cout);
+#if SIM_PROFILE
+            writeFlatProfile(profile, prog, run);
+#endif
+        }
+        if (!opts.checkpoint_path.empty())
+        {
+            Checkpoint::save(opts.checkpoint_path, cpu, prog, run.path, run.base, run.big_endian, before + executed, caches.get(),
+                             opts.use_pipeline ? &pipe.predictor : nullptr);
+            cout << "Checkpoint at instruction " << before + executed << " written to " << opts.checkpoint_path << "\n";
+        }
+        cpu.printRegisters();
+    }
+    catch (const MemoryFault &e) // PC ถูกเลื่อนไปแล้ว คำสั่งที่ error คือ PC - 4
+    {
+        cerr << "Error: " << e.what() << " (PC 0x" << hex << (uint32_t)(cpu.PC - 4) << dec << ")" << endl;
+        return 1;
+    }
+    catch (const exception &e)
+    {
+        cerr << "Error: " << e.what() << endl;
+        return 1;
+    }
+    return 0;
+}
+
+int main(int argc, char *argv[]) // start
 {
     CPU cpu;
     string command;
 
+    if (argc > 1) // มีชื่อไฟล์มา = program mode
+    {
+        RunOptions opts;
+        try
+        {
+            opts = parseOptions(vector<string>(argv + 1, argv + argc));
+        }
+        catch (const exception &e)
+        {
+            cerr << "Error: " << e.what() << endl;
+            cerr << "Usage: sim_cpu [--base addr] [--le] [--interp] [--cache] [--l1i|--l1d|--l2 size:ways:line[:lru|plru|random[:wb|wt[:latency]]]]\n"
+                    "               [--mem-latency cycles] [--pipeline] [--branch-resolve id|ex] [--predictor not-taken|bimodal|gshare]\n"
+                    "               [--cores n] [--quantum instructions] [--batch [--threads n] [--lanes k]] [--profile] [--profile-out file]\n"
+                    "               [--trace file [--trace-raw]] [--read-trace file]\n"
+                    "               [--checkpoint file] [--restore file]\n"
+                    "               [program.(asm|bin|elf) | manifest.jsonl] [max_instructions]" << endl;
+            return 1;
+        }
+        return runProgramMode(cpu, opts);
+    }
+
     while (true)
     {
         // program guide
@@ -364,6 +1134,11 @@ int main() // start
         cout << "or\n";
         cout << "slt\n";
         cout << "li\n";
+        cout << "addu subu addi addiu xor nor sltu slti sltiu andi ori xori lui\n";
+        cout << "sll srl sra sllv srlv srav clz clo movz movn\n";
+        cout << "mult multu div divu madd maddu msub msubu mfhi mflo mthi mtlo\n";
+        cout << "lb lbu lh lhu sb sh ll sc bltz bgez blez bgtz bltzal bgezal jalr teq\n";
+        cout << "move nop b beqz bnez la\n";
         cout << "Enter assembly instuction (type 'exit' to quit):\n";
         cout << "> ";
         // read string
@@ -386,4 +1161,4 @@ int main() // start
         }
     }
     return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,738 @@
+/*  ทดสอบ kernel ใน kernels/ กับทุก engine (run, runBlocks, runPipeline, run + cache)
+    แต่ละ kernel ต้องได้ register / memory ตรงกับค่าที่คำนวณด้วย C++ และทุก engine ต้องทำจำนวนคำสั่งเท่ากัน
+    จบด้วย exit code 0 ถ้าผ่านทั้งหมด (ใช้กับ ctest)
+*/
+#include "cpu.h"
+
+#include <tuple>
+
+#ifndef KERNEL_DIR
+#define KERNEL_DIR "kernels"
+#endif
+
+static int failures = 0;
+
+#define CHECK_EQ(actual, expected, what)                                                                 \
+    do                                                                                                   \
+    {                                                                                                    \
+        long long a_ = (long long)(actual), e_ = (long long)(expected);                                  \
+        if (a_ != e_)                                                                                    \
+        {                                                                                                \
+            cerr << "FAIL " << what << ": got " << a_ << ", expected " << e_ << " (" << __LINE__ << ")\n"; \
+            failures++;                                                                                  \
+        }                                                                                                \
+    } while (0)
+
+enum Engine
+{
+    ENGINE_INTERP,
+    ENGINE_BLOCKS,
+    ENGINE_PIPELINE,
+    ENGINE_CACHE,
+};
+
+static const char *const engine_names[] = {"interp", "blocks", "pipeline", "cache"};
+
+// ค่าที่ kernel ต้องได้: register และ word ใน memory (address จาก label + offset)
+struct Expected
+{
+    vector<pair<int, int>> registers;
+    vector<tuple<string, uint32_t, int>> words; // label, byte offset, ค่า
+};
+
+struct Kernel
+{
+    string file;
+    Expected expected;
+};
+
+static uint32_t labelAddress(const Program &prog, const string &label)
+{
+    auto it = prog.data_labels.find(label);
+    if (it == prog.data_labels.end())
+        throw runtime_error("Missing label " + label);
+    return it->second;
+}
+
+// รัน kernel ด้วย engine ที่เลือก คืนจำนวนคำสั่ง
+static long long runKernel(CPU &cpu, const Program &prog, Engine engine)
+{
+    cpu.load(prog);
+    if (engine == ENGINE_BLOCKS)
+        return cpu.runBlocks();
+    if (engine == ENGINE_PIPELINE)
+    {
+        Pipeline pipe(BranchPredictor(PRED_GSHARE), true);
+        long long executed = cpu.runPipeline(pipe);
+        CHECK_EQ(pipe.instructions, executed, prog.code.size() << " pipeline instructions");
+        return executed;
+    }
+    if (engine == ENGINE_CACHE)
+    {
+        CacheConfig l1;
+        CacheConfig l2 = {256 * 1024, 8, 64, REPL_LRU, true, 10};
+        CacheHierarchy caches(l1, l1, l2);
+        cpu.caches = &caches;
+        long long executed = cpu.run();
+        cpu.caches = nullptr;
+        CHECK_EQ(caches.l1i.accesses(), executed, "cache fetches");
+        return executed;
+    }
+    return cpu.run();
+}
+
+static void checkKernel(const Kernel &kernel)
+{
+    string path = string(KERNEL_DIR) + "/" + kernel.file;
+    long long reference = -1;
+    for (int e = ENGINE_INTERP; e <= ENGINE_CACHE; e++)
+    {
+        CPU cpu;
+        Program prog = cpu.loadProgram(path);
+        long long executed = runKernel(cpu, prog, (Engine)e);
+        string where = kernel.file + " [" + engine_names[e] + "]";
+
+        if (!cpu.halted())
+        {
+            cerr << "FAIL " << where << ": did not halt\n";
+            failures++;
+        }
+        if (reference < 0)
+            reference = executed;
+        CHECK_EQ(executed, reference, where + " instruction count");
+        for (const auto &reg : kernel.expected.registers)
+            CHECK_EQ(cpu.registers[reg.first], reg.second, where + " " + REGISTER_NAMES[reg.first]);
+        for (const auto &word : kernel.expected.words)
+        {
+            uint32_t addr = labelAddress(prog, get<0>(word)) + get<1>(word);
+            CHECK_EQ((int)cpu.memory.read32(addr), get<2>(word), where + " " + get<0>(word) + "+" + to_string(get<1>(word)));
+        }
+    }
+    cout << "ok " << kernel.file << " (" << reference << " instructions)\n";
+}
+
+static Kernel matmulKernel()
+{
+    const int n = 16;
+    Kernel k{"matmul.asm", {}};
+    int total = 0;
+    for (int i = 0; i < n; i++)
+    {
+        for (int j = 0; j < n; j++)
+        {
+            int sum = 0;
+            for (int m = 0; m < n; m++)
+                sum += (i + m) * (m - j);
+            total += sum;
+            k.expected.words.emplace_back("C", (uint32_t)(i * n + j) * 4, sum);
+        }
+    }
+    k.expected.registers.push_back({2, total});
+    return k;
+}
+
+static Kernel memcpyKernel()
+{
+    const int n = 4096;
+    Kernel k{"memcpy.asm", {}};
+    int total = 0;
+    for (int i = 0; i < n; i++)
+    {
+        total += 3 * i + 1;
+        if (i % 511 == 0 || i == n - 1)
+            k.expected.words.emplace_back("dst", (uint32_t)i * 4, 3 * i + 1);
+    }
+    k.expected.registers.push_back({2, total});
+    return k;
+}
+
+static Kernel bubbleSortKernel()
+{
+    const int n = 128;
+    Kernel k{"bubble_sort.asm", {}};
+    vector<int> values;
+    int x = 1, total = 0;
+    for (int i = 0; i < n; i++)
+    {
+        values.push_back(x);
+        total += x;
+        x = (x * 13 + 7) & 1023;
+    }
+    sort(values.begin(), values.end());
+    for (int i = 0; i < n; i++)
+        k.expected.words.emplace_back("array", (uint32_t)i * 4, values[i]);
+    k.expected.registers = {{2, 1}, {3, total}};
+    return k;
+}
+
+static Kernel collatzKernel()
+{
+    Kernel k{"collatz.asm", {}};
+    k.expected.registers = {{2, 111}, {3, 9232}};
+    return k;
+}
+
+static Kernel fibKernel()
+{
+    int a = 0, b = 1;
+    for (int i = 0; i < 20; i++)
+    {
+        int next = a + b;
+        a = b;
+        b = next;
+    }
+    Kernel k{"fib.asm", {}};
+    k.expected.registers = {{2, a}, {29, 0x7FFFEFFC}}; // $sp ต้องกลับมาที่เดิม
+    return k;
+}
+
+static Kernel listWalkKernel()
+{
+    const int n = 1024;
+    Kernel k{"list_walk.asm", {}};
+    k.expected.registers = {{2, 8 * (n * (n - 1) / 2)}, {3, 8 * n}};
+    // node ลำดับที่ 1 อยู่ช่อง 37 และ next ของ node แรกชี้ไปที่นั่น
+    k.expected.words.emplace_back("nodes", 37 * 8, 1);
+    k.expected.words.emplace_back("nodes", 4, 0x10010000 + 37 * 8);
+    return k;
+}
+
+static Kernel crc32Kernel()
+{
+    const int n = 1024;
+    vector<uint8_t> buffer(n);
+    for (int i = 0; i < n; i++)
+        buffer[i] = (uint8_t)((i * 7 + 3) & 0xFF);
+    uint32_t crc = 0xFFFFFFFFu;
+    for (uint8_t byte : buffer)
+    {
+        crc ^= byte;
+        for (int b = 0; b < 8; b++)
+            crc = (crc >> 1) ^ (0xEDB88320u & (0u - (crc & 1)));
+    }
+    crc = ~crc;
+    Kernel k{"crc32.asm", {}};
+    k.expected.registers = {{2, (int)crc}, {3, (int)(crc % 65521)}, {4, (int8_t)buffer[n - 1]}};
+    k.expected.words.emplace_back("result", 0, (int)crc);
+    return k;
+}
+
+// assemble โปรแกรมสั้นๆ แล้วรันใน cpu ที่ล้างแล้ว (prog ต้องอยู่จนกว่าจะใช้ cpu เสร็จ)
+static void runSnippet(CPU &cpu, Program &prog, const vector<string> &lines, bool blocks)
+{
+    cpu.reset();
+    prog = cpu.assemble(lines);
+    cpu.load(prog);
+    if (blocks)
+        cpu.runBlocks();
+    else
+        cpu.run();
+}
+
+// ความหมายของคำสั่ง MIPS32 ที่ kernel ไม่ได้ใช้: $zero, overflow, hi/lo, load/store ขนาด byte/half, jalr, trap
+static void checkInstructions()
+{
+    for (bool blocks : {false, true})
+    {
+        string where = blocks ? "[blocks] " : "[interp] ";
+        CPU cpu;
+        Program prog;
+        runSnippet(cpu, prog, {
+            "li $t0, 0x7FFFFFFF",
+            "addiu $zero, $t0, 1",  // เขียน $zero ไม่มีผล
+            "addu $t8, $t0, $t0",   // wrap
+            "addiu $t9, $t0, 1",
+            "li $t0, -7",
+            "li $t1, 2",
+            "div $t0, $t1",
+            "mflo $s0",
+            "mfhi $s1",
+            "multu $t0, $t1",
+            "mflo $s2",
+            "mfhi $s3",
+            "sra $s4, $t0, 1",
+            "srl $s5, $t0, 1",
+            "sltiu $s6, $t1, -1",
+            "sltu $s7, $t0, $t1",
+            "li $a0, 0x80000000",
+            "li $a1, -1",
+            "div $a0, $a1",         // ผลหารเกิน int32
+            "mflo $a2",
+            "mfhi $a3",
+        }, blocks);
+        CHECK_EQ(cpu.registers[0], 0, where + "$zero");
+        CHECK_EQ(cpu.registers[24], -2, where + "addu wrap");
+        CHECK_EQ(cpu.registers[25], INT32_MIN, where + "addiu wrap");
+        CHECK_EQ(cpu.registers[16], -3, where + "div lo");
+        CHECK_EQ(cpu.registers[17], -1, where + "div hi");
+        CHECK_EQ(cpu.registers[18], -14, where + "multu lo");
+        CHECK_EQ(cpu.registers[19], 1, where + "multu hi");
+        CHECK_EQ(cpu.registers[20], -4, where + "sra");
+        CHECK_EQ(cpu.registers[21], 0x7FFFFFFC, where + "srl");
+        CHECK_EQ(cpu.registers[22], 1, where + "sltiu");
+        CHECK_EQ(cpu.registers[23], 0, where + "sltu");
+        CHECK_EQ(cpu.registers[6], INT32_MIN, where + "div overflow lo");
+        CHECK_EQ(cpu.registers[7], 0, where + "div overflow hi");
+
+        runSnippet(cpu, prog, {
+            ".data",
+            "value: .half 0x80F1",
+            ".text",
+            "la $t0, value",
+            "lb $t1, 0($t0)",
+            "lbu $t2, 0($t0)",
+            "lh $t3, 0($t0)",
+            "lhu $t4, 0($t0)",
+            "li $t5, 0x1234ABCD",
+            "sh $t5, 2($t0)",
+            "sb $t5, 0($t0)",
+            "lw $t6, 0($t0)",
+            "lb $zero, 0($t0)",     // load ลง $zero ยังอ่าน memory แต่ไม่เก็บค่า
+            "li $s0, 0x00F00000",
+            "clz $s1, $s0",
+            "li $s2, -1",
+            "clo $s3, $s2",
+            "movz $s4, $s0, $zero",
+            "movn $s5, $s0, $zero",
+            "li $a0, 1",
+            "mthi $zero",
+            "mtlo $a0",
+            "madd $s2, $s2",        // hi:lo = 1 + (-1 * -1)
+            "msubu $s2, $a0",       // hi:lo = 2 - 0xFFFFFFFF
+            "mflo $s6",
+            "mfhi $s7",
+        }, blocks);
+        CHECK_EQ(cpu.registers[9], -15, where + "lb");
+        CHECK_EQ(cpu.registers[10], 0xF1, where + "lbu");
+        CHECK_EQ(cpu.registers[11], (int16_t)0x80F1, where + "lh");
+        CHECK_EQ(cpu.registers[12], 0x80F1, where + "lhu");
+        CHECK_EQ(cpu.registers[14], (int)0xABCD80CDu, where + "sb/sh");
+        CHECK_EQ(cpu.registers[0], 0, where + "lb $zero");
+        CHECK_EQ(cpu.registers[17], 8, where + "clz");
+        CHECK_EQ(cpu.registers[19], 32, where + "clo");
+        CHECK_EQ(cpu.registers[20], 0x00F00000, where + "movz");
+        CHECK_EQ(cpu.registers[21], 0, where + "movn");
+        CHECK_EQ(cpu.registers[22], 3, where + "madd/msubu lo");
+        CHECK_EQ(cpu.registers[23], -1, where + "madd/msubu hi");
+
+        runSnippet(cpu, prog, {
+            "la $t0, func",
+            "jalr $t0",
+            "li $s0, 7",
+            "bltzal $s0, func",     // ไม่กระโดดแต่ยังเขียน $ra
+            "move $s2, $ra",
+            "b end",
+            "func:",
+            "addiu $s1, $s1, 1",
+            "jr $ra",
+            "end:",
+        }, blocks);
+        CHECK_EQ(cpu.registers[17], 1, where + "jalr");
+        CHECK_EQ(cpu.registers[18], (int)prog.text_base + 16, where + "bltzal link");
+
+        // add/addi/sub trap ถ้า overflow และบอก PC ของคำสั่งที่ trap, teq trap ถ้าเท่ากัน
+        const vector<pair<vector<string>, string>> traps = {
+            {{"li $t0, 0x7FFFFFFF", "addi $t1, $t0, 1"}, "Integer overflow in addi at PC 0x4"},
+            {{"li $t0, 0x80000000", "li $t1, 1", "sub $t2, $t0, $t1"}, "Integer overflow in sub at PC 0x8"},
+            {{"li $t0, 0x40000000", "add $t1, $t0, $t0"}, "Integer overflow in add at PC 0x4"},
+            {{"li $t1, 5", "teq $t0, $zero"}, "Trap (teq) at PC 0x4"},
+        };
+        for (const auto &trap : traps)
+        {
+            string message;
+            try
+            {
+                runSnippet(cpu, prog, trap.first, blocks);
+            }
+            catch (const runtime_error &e)
+            {
+                message = e.what();
+            }
+            if (message != trap.second)
+            {
+                cerr << "FAIL " << where << "trap: got \"" << message << "\", expected \"" << trap.second << "\"\n";
+                failures++;
+            }
+        }
+    }
+
+    // directive ใน .data ที่ค่าเกินขอบเขตต้องเป็น error ของบรรทัดนั้น
+    const vector<pair<string, string>> bad_data = {
+        {".space -4", "line 2: .space size must not be negative: -4"},
+        {".space 0x7FFFFFFF", "line 2: .space does not fit below 0x80000000: 2147483647"},
+        {".align 32", "line 2: .align must be 0..31: 32"},
+        {".align -1", "line 2: .align must be 0..31: -1"},
+    };
+    for (const auto &bad : bad_data)
+    {
+        string message;
+        try
+        {
+            CPU cpu;
+            cpu.assemble({".data", bad.first});
+        }
+        catch (const runtime_error &e)
+        {
+            message = e.what();
+        }
+        if (message != bad.second)
+        {
+            cerr << "FAIL assemble \"" << bad.first << "\": got \"" << message << "\", expected \"" << bad.second << "\"\n";
+            failures++;
+        }
+    }
+
+    // machine code: ถอดรหัสแล้วแปลงกลับเป็นข้อความต้องได้คำสั่งเดิม
+    const vector<pair<uint32_t, string>> words = {
+        {0x24080005, "li $t0, 5"},         // addiu $t0, $zero, 5
+        {0x2509FFFF, "addiu $t1, $t0, -1"},
+        {0x00084082, "srl $t0, $t0, 2"},
+        {0x0109001B, "divu $t0, $t1"},
+        {0x0500FFFE, "bltz $t0, -2"},
+        {0x8109FFFC, "lb $t1, -4($t0)"},
+        {0x0100F809, "jalr $ra, $t0"},
+        {0x3C011234, "li $at, 305397760"}, // lui $at, 0x1234
+    };
+    CPU cpu;
+    for (const auto &word : words)
+    {
+        string text = formatInstr(cpu.decodeWord(word.first, 0));
+        if (text != word.second)
+        {
+            cerr << "FAIL decodeWord 0x" << hex << word.first << dec << ": got \"" << text << "\", expected \"" << word.second << "\"\n";
+            failures++;
+        }
+    }
+    cout << "ok instructions\n";
+}
+
+/*  รัน prog ทุก lane ของ LockstepCPU ($a0 = inputs[lane] จำกัด limits[lane] คำสั่ง แล้วรันต่อจนจบ)
+    เทียบกับ CPU ที่รันทีละคำสั่ง: register, hi/lo, memory word ที่ label, PC, จำนวนคำสั่ง และ error ต้องตรงกันทุก lane
+*/
+static void checkLockstep(const string &name, const Program &prog, const vector<int> &inputs, const vector<long long> &limits,
+                          const string &data_label = "")
+{
+    uint32_t lanes = (uint32_t)inputs.size();
+    LockstepCPU group(lanes);
+    group.load(prog);
+    for (uint32_t lane = 0; lane < lanes; lane++)
+        group.reg(lane, 4) = inputs[lane];
+    long long total = group.run(limits);
+    total += group.run();
+
+    long long expected_total = 0;
+    for (uint32_t lane = 0; lane < lanes; lane++)
+    {
+        CPU cpu;
+        cpu.load(prog);
+        cpu.registers[4] = inputs[lane];
+        long long executed = 0;
+        string error;
+        try
+        {
+            for (; !cpu.halted(); executed++)
+                cpu.run(1);
+        }
+        catch (const exception &e)
+        {
+            error = e.what();
+        }
+        expected_total += executed;
+
+        string where = "lockstep " + name + " lane " + to_string(lane);
+        CHECK_EQ(group.executed[lane], executed, where + " instruction count");
+        CHECK_EQ(group.pc[lane], (uint32_t)cpu.PC, where + " PC");
+        CHECK_EQ(group.hi[lane], cpu.hi, where + " hi");
+        CHECK_EQ(group.lo[lane], cpu.lo, where + " lo");
+        for (int r = 0; r < 32; r++)
+            CHECK_EQ(group.reg(lane, r), cpu.registers[r], where + " " + REGISTER_NAMES[r]);
+        if (!data_label.empty())
+        {
+            uint32_t addr = labelAddress(prog, data_label);
+            CHECK_EQ((int)group.memory[lane].read32(addr), (int)cpu.memory.read32(addr), where + " " + data_label);
+        }
+        if (group.fault[lane] != error)
+        {
+            cerr << "FAIL " << where << ": error \"" << group.fault[lane] << "\", expected \"" << error << "\"\n";
+            failures++;
+        }
+    }
+    CHECK_EQ(total, expected_total, "lockstep " + name + " total instructions");
+}
+
+// lockstep engine ต้องได้ผลเหมือน CPU::run ทุก lane ทั้งตอน branch / jr แยกทาง, ครบ limit กลางทาง และ lane ที่ error
+static void checkLockstep()
+{
+    CPU cpu;
+    string dir = string(KERNEL_DIR) + "/";
+
+    Program collatz = cpu.loadProgram(dir + "collatz.asm");
+    vector<int> inputs;
+    vector<long long> limits;
+    for (int lane = 0; lane < 37; lane++) // ไม่ลงตัวกับความกว้าง SIMD
+    {
+        inputs.push_back(lane * 7 % 53);
+        limits.push_back(lane % 5 == 3 ? 40 + lane : LLONG_MAX);
+    }
+    checkLockstep("collatz", collatz, inputs, limits);
+
+    Program fib = cpu.loadProgram(dir + "fib.asm");
+    checkLockstep("fib", fib, vector<int>(5, 0), vector<long long>(5, LLONG_MAX));
+    Program crc32 = cpu.loadProgram(dir + "crc32.asm");
+    checkLockstep("crc32", crc32, vector<int>(3, 0), {1000, LLONG_MAX, 0}, "result");
+
+    // lane ที่ overflow / อ่าน address ไม่ตรง / trap ต้องจบด้วย error เดียวกับ CPU ส่วน lane อื่นทำต่อ
+    Program faults = cpu.assemble({
+        "    li $t0, 3",
+        "    and $t1, $a0, $t0",
+        "    li $t2, 1",
+        "    beq $t1, $t2, overflow",
+        "    li $t2, 2",
+        "    beq $t1, $t2, misaligned",
+        "    teq $t1, $t0",
+        "    div $a0, $t0",
+        "    mfhi $v0",
+        "    mflo $v1",
+        "    j end",
+        "overflow:",
+        "    li $t3, 0x7FFFFFFF",
+        "    add $v0, $t3, $a0",
+        "    j end",
+        "misaligned:",
+        "    lw $v0, 2($sp)",
+        "end:",
+    });
+    checkLockstep("faults", faults, {0, 1, 2, 3, 4, 5, -1, 8, 9}, vector<long long>(9, LLONG_MAX));
+    cout << "ok lockstep (" << LockstepCPU::simdName() << ")\n";
+}
+
+// เขียน machine code (big endian) ลงไฟล์ flat binary
+static void writeBinary(const string &file, const vector<uint32_t> &words)
+{
+    ofstream out(file, ios::binary);
+    for (uint32_t word : words)
+    {
+        const char bytes[4] = {(char)(word >> 24), (char)(word >> 16), (char)(word >> 8), (char)word};
+        out.write(bytes, 4);
+    }
+}
+
+/*  โปรแกรมที่แก้ตัวเองใน loop (flat binary ที่ text อยู่ใน memory): ทุกรอบ sw เขียนทับ addiu ใน loop ด้วย word เดิม
+    runBlocks ต้องแปล block ใหม่ทุกรอบแต่ใช้ช่องเดิมใน blocks ซ้ำ (blocks ต้องไม่โตตามจำนวนรอบ)
+*/
+static void checkSelfModifying()
+{
+    string file = "kernel_tests_smc.bin";
+    writeBinary(file, {
+        0x240803E8, // addiu $t0, $zero, 1000
+        0x8C09000C, // loop: lw $t1, 12($zero)
+        0xAC09000C, //       sw $t1, 12($zero)   เขียนทับคำสั่งถัดไป
+        0x24420001, //       addiu $v0, $v0, 1
+        0x2508FFFF, //       addiu $t0, $t0, -1
+        0x1500FFFB, //       bne $t0, $zero, loop
+    });
+    CPU cpu;
+    Program prog = cpu.loadBinary(file);
+    remove(file.c_str());
+    cpu.load(prog);
+    long long executed = cpu.runBlocks();
+
+    CHECK_EQ(cpu.registers[2], 1000, "self-modifying $v0");
+    CHECK_EQ(executed, 1 + 5 * 1000, "self-modifying instruction count");
+    if (cpu.blocks.size() > 4)
+    {
+        cerr << "FAIL self-modifying: " << cpu.blocks.size() << " blocks cached\n";
+        failures++;
+    }
+    cout << "ok self-modifying code (" << cpu.blocks.size() << " blocks)\n";
+
+    // multi-core: core 0 เขียนทับ "j spin" ที่ core 1 วนอยู่ให้เป็น "j end" core 1 ต้องเห็นโค้ดใหม่หลัง barrier แล้วจบ
+    file = "kernel_tests_smc_mc.bin";
+    writeBinary(file, {
+        0x14800003, // bne $a0, $zero, spin
+        0x8C080018, // lw $t0, 24($zero)     word ของ "j end" ด้านล่าง
+        0xAC080014, // sw $t0, 20($zero)     เขียนทับ "j spin"
+        0x08000007, // j end
+        0x24420001, // spin: addiu $v0, $v0, 1
+        0x08000004, //       j spin
+        0x08000007, // (ข้อมูล) j end
+    });
+    Program shared = cpu.loadBinary(file);
+    remove(file.c_str());
+    for (bool blocks : {false, true})
+    {
+        MultiCore mc(2);
+        mc.load(shared);
+        mc.run(1000000, 100, blocks);
+        for (size_t i = 0; i < mc.cores.size(); i++)
+        {
+            if (!mc.cores[i]->halted())
+            {
+                cerr << "FAIL self-modifying multi-core " << (blocks ? "[blocks]" : "[interp]") << ": core " << i << " did not see the new code\n";
+                failures++;
+            }
+        }
+    }
+    cout << "ok self-modifying code across cores\n";
+}
+
+/*  โปรแกรมที่วาง segment ไว้นอก memory ของ user (base 0x80000000) ต้อง fault ตอน load ก่อนมี core ไหนรัน
+    fault_core ต้องยังเป็น -1 (sim_cpu ใช้แยก fault ตอน load ออกจาก fault ตอนรัน)
+*/
+static void checkLoadFault()
+{
+    string file = "kernel_tests_high.bin";
+    writeBinary(file, {0x24020001}); // addiu $v0, $zero, 1
+    CPU cpu;
+    Program prog = cpu.loadBinary(file, 0x80000000);
+    remove(file.c_str());
+    for (size_t count : {1, 2, 4})
+    {
+        MultiCore mc(count);
+        bool faulted = false;
+        try
+        {
+            mc.load(prog);
+        }
+        catch (const MemoryFault &e)
+        {
+            faulted = true;
+            CHECK_EQ(e.addr, 0x80000000u, "load fault address");
+        }
+        if (!faulted)
+        {
+            cerr << "FAIL load fault: " << count << " cores loaded a segment at 0x80000000\n";
+            failures++;
+        }
+        CHECK_EQ(mc.fault_core, -1, "load fault core");
+    }
+    cout << "ok load fault\n";
+}
+
+// load-use stall ของ pipeline: ค่าที่ store เขียน forward จาก MEM ได้ ส่วน address ของ store ต้องรอ
+static void checkPipelineHazards()
+{
+    const vector<pair<vector<string>, uint64_t>> cases = {
+        {{"lw $t0, 0($sp)", "sw $t0, 4($sp)"}, 0},  // store ค่าที่เพิ่งโหลด: MEM -> MEM
+        {{"lw $t0, 0($sp)", "sw $sp, 0($t0)"}, 1},  // address มาจาก load: รอ 1 cycle
+        {{"lw $t0, 0($sp)", "addu $t1, $t0, $t0"}, 1},
+        {{"li $t0, 8", "sw $t0, 4($sp)"}, 0},
+    };
+    for (const auto &test : cases)
+    {
+        CPU cpu;
+        Program prog = cpu.assemble(test.first);
+        cpu.load(prog);
+        cpu.memory.write32((uint32_t)cpu.registers[29], (uint32_t)cpu.registers[29] - 16); // ให้ address จาก lw ถูก alignment
+        Pipeline pipe;
+        cpu.runPipeline(pipe);
+        CHECK_EQ(pipe.stall_load_use, test.second, "pipeline load-use: " + test.first[0] + "; " + test.first[1]);
+    }
+    cout << "ok pipeline hazards\n";
+}
+
+// trace: sc ที่สำเร็จมี record ของ store ส่วน sc ที่ไม่สำเร็จมีแค่ $rt = 0
+static void checkTrace()
+{
+    CPU cpu;
+    Program prog = cpu.assemble({
+        "li $t1, 7",
+        "ll $t0, 0($sp)",
+        "sw $t1, 0($sp)",  // ค่าเปลี่ยน sc ถัดไปไม่สำเร็จ
+        "sc $t2, 0($sp)",
+        "ll $t0, 0($sp)",
+        "li $t3, 5",
+        "sc $t3, 0($sp)",
+    });
+    string file = "kernel_tests.trace";
+    cpu.load(prog);
+    {
+        TraceWriter trace(file, true);
+        cpu.runTrace(trace);
+        trace.close();
+    }
+    ostringstream text;
+    readTrace(file, text);
+    remove(file.c_str());
+
+    vector<string> lines;
+    istringstream in(text.str());
+    for (string line; getline(in, line);)
+        lines.push_back(line);
+    CHECK_EQ(lines.size(), prog.code.size(), "trace records");
+    if (lines.size() == prog.code.size())
+    {
+        const string &failed = lines[3], &succeeded = lines[6];
+        if (failed.find("store") != string::npos || failed.find("$t2 = 0") == string::npos)
+        {
+            cerr << "FAIL trace of failed sc: " << failed << "\n";
+            failures++;
+        }
+        if (succeeded.find("store") == string::npos || succeeded.find("$t3 = 1") == string::npos)
+        {
+            cerr << "FAIL trace of successful sc: " << succeeded << "\n";
+            failures++;
+        }
+    }
+    CHECK_EQ(cpu.memory.read32((uint32_t)cpu.registers[29]), 5, "sc stored value");
+    cout << "ok trace\n";
+}
+
+// checkpoint กลางทาง แล้ว restore ใน CPU ใหม่ต้องได้ผลเหมือนรันรวดเดียว
+static void checkCheckpoint()
+{
+    string path = string(KERNEL_DIR) + "/fib.asm";
+    string file = "kernel_tests_fib.ckpt";
+
+    CPU full;
+    Program prog = full.loadProgram(path);
+    full.load(prog);
+    long long total = full.runBlocks();
+
+    CPU first;
+    first.load(prog);
+    long long half = first.run(total / 2);
+    Checkpoint::save(file, first, prog, path, 0, true, half, nullptr, nullptr);
+
+    CPU second;
+    Checkpoint checkpoint(file);
+    second.load(prog, false);
+    checkpoint.restore(second, prog, nullptr, nullptr);
+    long long rest = second.runBlocks();
+    remove(file.c_str());
+
+    CHECK_EQ(checkpoint.executed, half, "checkpoint instruction count");
+    CHECK_EQ(half + rest, total, "checkpoint total instructions");
+    for (int r = 0; r < 32; r++)
+        CHECK_EQ(second.registers[r], full.registers[r], string("checkpoint ") + REGISTER_NAMES[r]);
+    cout << "ok checkpoint/restore\n";
+}
+
+int main()
+{
+    try
+    {
+        for (const Kernel &kernel : {matmulKernel(), memcpyKernel(), bubbleSortKernel(), fibKernel(), listWalkKernel(), crc32Kernel(),
+                                      collatzKernel()})
+            checkKernel(kernel);
+        checkInstructions();
+        checkLockstep();
+        checkSelfModifying();
+        checkLoadFault();
+        checkPipelineHazards();
+        checkTrace();
+        checkCheckpoint();
+    }
+    catch (const exception &e)
+    {
+        cerr << "FAIL: " << e.what() << endl;
+        return 1;
+    }
+    if (failures)
+    {
+        cerr << failures << " check(s) failed" << endl;
+        return 1;
+    }
+    cout << "All kernel tests passed" << endl;
+    return 0;
+}